@@ -0,0 +1,87 @@
+#ifndef AABB_H
+#define AABB_H
+
+/*
+Axis-aligned bounding box, stored as one interval per axis.
+Used by the bvh to cull whole groups of objects with a single slab test.
+*/
+class aabb {
+  public:
+    interval x, y, z;
+
+    aabb() {} // intervals default to empty, so the box starts out empty
+
+    aabb(const interval& x, const interval& y, const interval& z) : x(x), y(y), z(z) {}
+
+    aabb(const point3& a, const point3& b) {
+        // treat the two points as extrema, so don't need a particular min/max order
+        x = (a[0] <= b[0]) ? interval(a[0], b[0]) : interval(b[0], a[0]);
+        y = (a[1] <= b[1]) ? interval(a[1], b[1]) : interval(b[1], a[1]);
+        z = (a[2] <= b[2]) ? interval(a[2], b[2]) : interval(b[2], a[2]);
+    }
+
+    aabb(const aabb& box0, const aabb& box1) {
+        x = interval(box0.x, box1.x);
+        y = interval(box0.y, box1.y);
+        z = interval(box0.z, box1.z);
+    }
+
+    const interval& axis_interval(int n) const {
+        if (n == 1) return y;
+        if (n == 2) return z;
+        return x;
+    }
+
+    bool is_empty() const {
+        return x.min > x.max || y.min > y.max || z.min > z.max;
+    }
+
+    point3 centroid() const {
+        return point3(0.5*(x.min + x.max), 0.5*(y.min + y.max), 0.5*(z.min + z.max));
+    }
+
+    double surface_area() const {
+        if (is_empty()) return 0;
+        auto dx = x.size(), dy = y.size(), dz = z.size();
+        return 2 * (dx*dy + dy*dz + dz*dx);
+    }
+
+    int longest_axis() const {
+        if (x.size() > y.size())
+            return x.size() > z.size() ? 0 : 2;
+        return y.size() > z.size() ? 1 : 2;
+    }
+
+    bool hit(const ray& r, interval ray_t) const {
+        const point3& orig = r.origin();
+        const vec3 inv_dir(1 / r.direction().x(), 1 / r.direction().y(), 1 / r.direction().z());
+        real t_enter;
+        return hit(orig, inv_dir, ray_t, t_enter);
+    }
+
+    // slab test with the reciprocal direction precomputed by the caller (done once per ray
+    // in bvh traversal rather than once per box). t_enter is the distance the ray enters the box.
+    bool hit(const point3& orig, const vec3& inv_dir, interval ray_t, real& t_enter) const {
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& ax = axis_interval(axis);
+            auto t0 = (ax.min - orig[axis]) * inv_dir[axis];
+            auto t1 = (ax.max - orig[axis]) * inv_dir[axis];
+            if (t0 > t1) std::swap(t0, t1);
+
+            if (t0 > ray_t.min) ray_t.min = t0;
+            if (t1 < ray_t.max) ray_t.max = t1;
+
+            if (ray_t.max < ray_t.min)
+                return false;
+        }
+        t_enter = ray_t.min;
+        return true;
+    }
+
+    static const aabb empty, universe;
+};
+
+const aabb aabb::empty    = aabb(interval::empty,    interval::empty,    interval::empty);
+const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef ACCUMULATOR_H
+#define ACCUMULATOR_H
+
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+Running sum of camera samples for a progressive render, plus how many samples every pixel
+has had so far. Sums are kept in double so long renders don't lose the small late samples.
+Can be checkpointed to disk and loaded back to carry on rendering where it stopped, by a
+render with the same identity: the camera's fingerprint of the scene and settings (see
+camera::fingerprint), so a checkpoint is never carried on with samples of something else.
+*/
+class accumulator {
+  public:
+    accumulator() {}
+
+    accumulator(int width, int height, uint64_t identity = 0)
+        : image_width(width), image_height(height), identity(identity), sums(size_t(3) * width * height, 0.0) {}
+
+    int width() const { return image_width; }
+    int height() const { return image_height; }
+    int samples() const { return sample_count; }
+
+    void add(int i, int j, const colour& sum) {
+        double* p = &sums[3 * (size_t(j) * image_width + i)];
+        p[0] += sum.x();
+        p[1] += sum.y();
+        p[2] += sum.z();
+    }
+
+    // called once a pass has added the same number of samples to every pixel
+    void add_samples(int n) { sample_count += n; }
+
+    // average of the samples so far
+    framebuffer resolve() const {
+        framebuffer image(image_width, image_height);
+        double scale = sample_count > 0 ? 1.0 / sample_count : 0.0;
+        float* dst = image.data();
+        for (size_t k = 0; k < sums.size(); k++)
+            dst[k] = float(sums[k] * scale);
+        return image;
+    }
+
+    // checkpoint layout: "RTACC2\n", then int32 width, height, samples, uint64 identity, then
+    // the sums as doubles, all in native byte order. written to a temporary file and renamed
+    // over the old checkpoint, so a process killed mid-write leaves the previous one intact.
+    bool save(const std::string& path) const {
+        std::string tmp = path + ".tmp";
+        FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f)
+            return false;
+
+        int32_t header[3] = { image_width, image_height, sample_count };
+        bool ok = std::fwrite(magic, 1, sizeof(magic), f) == sizeof(magic)
+               && std::fwrite(header, sizeof(header), 1, f) == 1
+               && std::fwrite(&identity, sizeof(identity), 1, f) == 1
+               && std::fwrite(sums.data(), sizeof(double), sums.size(), f) == sums.size();
+        ok = (std::fclose(f) == 0) && ok;
+
+        return ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    // carries on from the checkpoint at path, which has to be for this accumulator's size and
+    // identity. on false nothing has changed, and error says what was wrong with the file, or
+    // is left empty if there isn't one
+    bool load(const std::string& path, std::string& error) {
+        error.clear();
+        FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f)
+            return false;
+
+        char file_magic[sizeof(magic)];
+        int32_t header[3];
+        uint64_t file_identity;
+        std::vector<double> file_sums;
+        if (std::fread(file_magic, 1, sizeof(magic), f) != sizeof(magic)
+            || !std::equal(file_magic, file_magic + sizeof(magic), magic)
+            || std::fread(header, sizeof(header), 1, f) != 1
+            || std::fread(&file_identity, sizeof(file_identity), 1, f) != 1) {
+            error = "checkpoint " + path + " isn't a checkpoint, or is from an older version";
+        } else if (header[0] != image_width || header[1] != image_height || header[2] < 0) {
+            error = "checkpoint " + path + " is for a different image size";
+        } else if (file_identity != identity) {
+            error = "checkpoint " + path + " is for a different scene, camera, sampler or frame (or, with the stratified sampler, sample count)";
+        } else {
+            file_sums.resize(sums.size());
+            if (std::fread(file_sums.data(), sizeof(double), file_sums.size(), f) != file_sums.size())
+                error = "checkpoint " + path + " is cut short";
+        }
+        std::fclose(f);
+        if (!error.empty())
+            return false;
+
+        sample_count = header[2];
+        sums = std::move(file_sums);
+        return true;
+    }
+
+  private:
+    static constexpr char magic[7] = { 'R', 'T', 'A', 'C', 'C', '2', '\n' };
+
+    int image_width = 0;
+    int image_height = 0;
+    int sample_count = 0;
+    uint64_t identity = 0;
+    std::vector<double> sums;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <vector>
+
+// the camera settings an animation can key, at a frame
+struct camera_key {
+    double frame = 0;
+    point3 lookfrom = point3(0, 0, 0);
+    point3 lookat   = point3(0, 0, -1);
+    double vfov = 90;
+    double focus_distance = 10;
+};
+
+/*
+Keyframed camera settings. Frames between two keys get a linear blend of them, frames
+before the first or after the last key hold it. Everything a key doesn't cover (image size,
+samples, vup, defocus_angle) is whatever the camera already has.
+*/
+class camera_path {
+  public:
+    bool empty() const { return keys.empty(); }
+    size_t size() const { return keys.size(); }
+    const std::vector<camera_key>& all() const { return keys; }
+
+    // keys can be added in any order
+    void add(const camera_key& key) {
+        auto at = std::upper_bound(keys.begin(), keys.end(), key.frame,
+                                   [](double frame, const camera_key& k) { return frame < k.frame; });
+        keys.insert(at, key);
+    }
+
+    // the settings at a frame, fractional frames included. needs at least one key.
+    camera_key at(double frame) const {
+        if (frame <= keys.front().frame)
+            return keys.front();
+        if (frame >= keys.back().frame)
+            return keys.back();
+
+        auto next = std::upper_bound(keys.begin(), keys.end(), frame,
+                                     [](double f, const camera_key& k) { return f < k.frame; });
+        const camera_key& a = next[-1];
+        const camera_key& b = *next;
+        double t = (frame - a.frame) / (b.frame - a.frame);
+
+        camera_key key;
+        key.frame = frame;
+        key.lookfrom = (1 - t) * a.lookfrom + t * b.lookfrom;
+        key.lookat = (1 - t) * a.lookat + t * b.lookat;
+        key.vfov = (1 - t) * a.vfov + t * b.vfov;
+        key.focus_distance = (1 - t) * a.focus_distance + t * b.focus_distance;
+        return key;
+    }
+
+    // sets the camera up for a frame
+    void apply(camera& cam, double frame) const {
+        if (keys.empty())
+            return;
+        camera_key key = at(frame);
+        cam.lookfrom = key.lookfrom;
+        cam.lookat = key.lookat;
+        cam.vfov = key.vfov;
+        cam.focus_distance = key.focus_distance;
+    }
+
+  private:
+    std::vector<camera_key> keys; // sorted by frame
+};
+
+// a turntable: the camera circles its lookat point about the vertical axis once over
+// frame_count frames, starting where it is and keeping its height, distance and lens.
+// keyed on every frame, since a linear blend between a few keys would cut the corners.
+inline camera_path orbit(const camera& cam, int frame_count) {
+    camera_path path;
+    vec3 offset = cam.lookfrom - cam.lookat;
+    for (int k = 0; k < frame_count; k++) {
+        double angle = 2 * pi * k / frame_count;
+        double c = std::cos(angle), s = std::sin(angle);
+        camera_key key;
+        key.frame = k;
+        key.lookfrom = cam.lookat + vec3(c * offset.x() + s * offset.z(), offset.y(), -s * offset.x() + c * offset.z());
+        key.lookat = cam.lookat;
+        key.vfov = cam.vfov;
+        key.focus_distance = cam.focus_distance;
+        path.add(key);
+    }
+    return path;
+}
+
+// the file name of a frame: the last run of '#' in pattern is replaced by the frame number,
+// zero padded to the run's length, e.g. "turntable_####.png" gives "turntable_0007.png". a
+// pattern without '#' gets "_0007" before its extension.
+inline std::string frame_path(const std::string& pattern, int frame) {
+    size_t last = pattern.rfind('#');
+    if (last == std::string::npos) {
+        size_t dot = pattern.rfind('.');
+        size_t slash = pattern.rfind('/');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            dot = pattern.size();
+        return frame_path(pattern.substr(0, dot) + "_####" + pattern.substr(dot), frame);
+    }
+    size_t first = last;
+    while (first > 0 && pattern[first - 1] == '#')
+        first--;
+
+    char number[32];
+    std::snprintf(number, sizeof(number), "%0*d", int(last - first + 1), frame);
+    return pattern.substr(0, first) + number + pattern.substr(last + 1);
+}
+
+/*
+Renders frames first .. first+count-1 of an animation of one world. The scene is whatever
+the caller built, once; the render threads are one pool kept for the whole batch; and each
+finished frame is handed to write_frame(frame, image) on a thread of its own while the next
+one renders, so saving frame k overlaps rendering frame k+1. write_frame returns false to
+stop the batch, after which this returns false too. Every frame has its own frame_index, so
+its noise differs from the last one's.
+*/
+template <typename World, typename WriteFrame>
+bool render_animation(camera& cam, const camera_path& path, int first, int count, const World& world,
+                      WriteFrame&& write_frame) {
+    thread_pool threads(cam.thread_count > 0 ? cam.thread_count : default_thread_count());
+    thread_pool* previous_pool = cam.pool;
+    cam.pool = &threads;
+
+    std::future<bool> writing; // the previous frame, while it's being written
+    bool ok = true;
+    for (int frame = first; frame < first + count && ok; frame++) {
+        path.apply(cam, frame);
+        cam.frame_index = frame;
+        framebuffer image = cam.render(world);
+
+        if (writing.valid())
+            ok = writing.get();
+        if (ok)
+            writing = std::async(std::launch::async, [&write_frame, frame, image = std::move(image)] {
+                return bool(write_frame(frame, image));
+            });
+    }
+    if (writing.valid())
+        ok = writing.get() && ok;
+
+    cam.pool = previous_pool;
+    return ok;
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef AOV_H
+#define AOV_H
+
+#include "framebuffer.h"
+#include "material.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+/*
+Auxiliary buffers (arbitrary output variables) from the first surface each camera ray hits:
+what the denoiser (see denoise.h) uses to tell an edge in the scene from noise. Each pixel
+averages the same camera rays as its colour, so edges and depth of field line up with it.
+*/
+class aov_buffers {
+  public:
+    framebuffer albedo; // the colour the surface reflects; the sky's own colour where rays miss
+    framebuffer normal; // world space, facing the camera; 0 where rays miss
+    framebuffer emission; // light seen coming straight off an emitter, which needs no denoising
+
+    aov_buffers() {}
+
+    aov_buffers(int width, int height)
+        : albedo(width, height), normal(width, height), emission(width, height),
+          depths(size_t(width) * height, 0.0f) {}
+
+    int width() const { return albedo.width(); }
+    int height() const { return albedo.height(); }
+
+    // distance from the camera to the surface, averaged over the rays that hit one;
+    // infinity where none did
+    float depth(int i, int j) const { return depths[size_t(j) * width() + i]; }
+    void set_depth(int i, int j, float d) { depths[size_t(j) * width() + i] = d; }
+
+    // the normals as colours, each axis from -1 .. 1 to 0 .. 1
+    framebuffer normal_image() const {
+        framebuffer image(width(), height());
+        for (int j = 0; j < height(); j++)
+            for (int i = 0; i < width(); i++)
+                image.set(i, j, 0.5 * (normal.get(i, j) + colour(1, 1, 1)));
+        return image;
+    }
+
+    // depth as grey, black at the camera and white at the farthest hit (or beyond it)
+    framebuffer depth_image() const {
+        float farthest = 0;
+        for (float d : depths)
+            if (std::isfinite(d))
+                farthest = std::max(farthest, d);
+        framebuffer image(width(), height());
+        for (int j = 0; j < height(); j++) {
+            for (int i = 0; i < width(); i++) {
+                float d = std::isfinite(depth(i, j)) ? depth(i, j) / std::max(farthest, 1e-6f) : 1.0f;
+                // squared, so it reads linearly once gamma corrected
+                image.set(i, j, colour(d * d, d * d, d * d));
+            }
+        }
+        return image;
+    }
+
+  private:
+    std::vector<float> depths;
+};
+
+// mirrors and clear glass are looked through, to the surfaces they reflect or refract:
+// theirs would be flat where the colour has all the detail of what they show. returns false
+// for any other surface, otherwise sets next to the ray on from rec and scales throughput
+// by what the surface lets through
+inline bool follow_specular(const material& m, const ray& r_in, const hit_record& rec, ray& next, colour& throughput) {
+    if (m.kind == material_kind::dielectric) {
+        next = static_cast<const dielectric&>(m).transmitted(r_in, rec);
+        return true;
+    }
+    if (m.kind == material_kind::metal && static_cast<const metal&>(m).fuzz == 0) {
+        vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
+        next = ray(rec.spawn_origin(reflected), reflected, r_in.time());
+        throughput = throughput * static_cast<const metal&>(m).albedo;
+        return true;
+    }
+    return false;
+}
+
+// the albedo aov of a surface: the colour it scales light by. glass passes everything, a
+// light counts as its own colour scaled into 0 .. 1, and materials outside the closed set
+// count as white, so the denoiser leaves their colour as it is
+inline colour surface_albedo(const material& m, const hit_record& rec) {
+    switch (m.kind) {
+        case material_kind::lambertian:
+            return static_cast<const lambertian&>(m).albedo;
+        case material_kind::metal:
+            return static_cast<const metal&>(m).albedo;
+        case material_kind::emissive: {
+            colour emit = static_cast<const diffuse_light&>(m).emitted(rec);
+            real brightest = std::max(emit.x(), std::max(emit.y(), emit.z()));
+            return brightest > 1 ? emit / brightest : emit;
+        }
+        default:
+            return colour(1, 1, 1);
+    }
+}
+
+#endif
@@ -0,0 +1,1242 @@
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+#include "bvh.h"
+#include "closed_world.h"
+#include "sphere_soup.h"
+#include "camera.h"
+#include "animation.h"
+#include "scenes.h"
+#include "scene_file.h"
+#include "image_writer.h"
+#include "mesh.h"
+#include "instance.h"
+#include "obj_file.h"
+#include "lights.h"
+#include "denoise.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <malloc.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Benchmarks for the renderer.
+Run with one or more suite names to pick what to run, or with no args to run everything.
+*/
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// centres of n small spheres scattered over a square patch sized so density stays constant
+// as n grows, i.e. the main.cpp layout scaled up to production sizes
+std::vector<point3> random_centers(int n) {
+    std::vector<point3> centers;
+    double side = std::sqrt(double(n));
+    for (int i = 0; i < n; i++)
+        centers.emplace_back(side * (random_double() - 0.5), 0.2, side * (random_double() - 0.5));
+    return centers;
+}
+
+hittable_list sphere_list(const std::vector<point3>& centers) {
+    hittable_list world;
+    for (const auto& center : centers) {
+        world.emplace<sphere>(center, 0.2, world.make_material(material_desc::make_lambertian(colour::random())));
+    }
+    return world;
+}
+
+hittable_list random_spheres(int n) {
+    return sphere_list(random_centers(n));
+}
+
+// rays from a camera above one edge of the patch towards random points on it
+std::vector<ray> patch_rays(int n_objects, int n_rays) {
+    double side = std::sqrt(double(n_objects));
+    point3 origin(0, 0.3 * side + 2, side);
+    std::vector<ray> rays;
+    rays.reserve(n_rays);
+    for (int i = 0; i < n_rays; i++) {
+        point3 target(side * (random_double() - 0.5), 0.2, side * (random_double() - 0.5));
+        rays.emplace_back(origin, target - origin);
+    }
+    return rays;
+}
+
+const char* simd_name(sphere_soup::simd_level level) {
+    switch (level) {
+        case sphere_soup::simd_level::avx2:  return "avx2";
+        case sphere_soup::simd_level::sse41: return "sse4.1";
+        default:                             return "scalar";
+    }
+}
+
+// returns rays per second of closest-hit queries
+double time_hits(const hittable& world, const std::vector<ray>& rays, int& hits) {
+    hits = 0;
+    hit_record rec;
+    auto start = bench_clock::now();
+    for (const auto& r : rays)
+        if (world.hit(r, interval(0.001, infinity), rec))
+            hits++;
+    return rays.size() / seconds_since(start);
+}
+
+void bench_bvh() {
+    std::cout << "bvh: closest-hit queries vs object count (linear list vs bvh)\n";
+    std::cout << "  objects  build_ms   list_Mrays/s  bvh_Mrays/s  speedup  nodes\n";
+
+    for (int n : {100, 1000, 10000, 100000}) {
+        auto world = random_spheres(n);
+        // cap the linear scan at ~2e7 sphere tests so the big scenes finish
+        auto list_rays = patch_rays(n, std::max(1000, 20000000 / n));
+        auto bvh_rays  = patch_rays(n, 200000);
+
+        int list_hits, bvh_hits;
+        double list_rate = time_hits(world, list_rays, list_hits);
+
+        auto start = bench_clock::now();
+        bvh tree(std::move(world));
+        double build_ms = 1000 * seconds_since(start);
+        double bvh_rate = time_hits(tree, bvh_rays, bvh_hits);
+
+        std::printf("  %7d  %8.2f  %13.3f  %11.3f  %7.1fx  %5zu\n",
+                    n, build_ms, list_rate / 1e6, bvh_rate / 1e6, bvh_rate / list_rate,
+                    tree.node_count());
+    }
+}
+
+void bench_rng() {
+    std::cout << "rng: uniform doubles per second\n";
+    const int n = 50000000;
+
+    // what random_double() used to be: shared static engine + distribution
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    std::mt19937 generator;
+    double sum = 0;
+    auto start = bench_clock::now();
+    for (int i = 0; i < n; i++)
+        sum += distribution(generator);
+    double mt_rate = n / seconds_since(start);
+
+    pcg32 rng;
+    start = bench_clock::now();
+    for (int i = 0; i < n; i++)
+        sum += random_double(rng);
+    double pcg_rate = n / seconds_since(start);
+
+    // per-sample seeding cost, paid once per camera sample
+    start = bench_clock::now();
+    for (int i = 0; i < n / 10; i++) {
+        pcg32 sample_rng = pcg32::for_sample(0, i, 0);
+        sum += random_double(sample_rng);
+    }
+    double seed_rate = (n / 10) / seconds_since(start);
+
+    std::printf("  mt19937:  %7.1f M/s  (%zu bytes state)\n", mt_rate / 1e6, sizeof(std::mt19937));
+    std::printf("  pcg32:    %7.1f M/s  (%zu bytes state)\n", pcg_rate / 1e6, sizeof(pcg32));
+    std::printf("  pcg32 seed per sample: %7.1f M/s\n", seed_rate / 1e6);
+    std::printf("  (checksum %f)\n", sum);
+}
+
+void bench_soup() {
+    std::cout << "soup: sphere objects vs structure-of-arrays sphere soup (Mrays/s)\n";
+    std::cout << "  simd detected: " << simd_name(sphere_soup::detect_simd()) << "\n";
+    std::cout << "  objects  layout        virtual   scalar   sse4.1     avx2\n";
+
+    for (int n : {40, 1000, 100000}) {
+        auto centers = random_centers(n);
+        auto rays = patch_rays(n, n <= 1000 ? 200000 : 500000);
+        // a few dozen spheres (the main.cpp scene) are cheapest as one flat run,
+        // anything bigger goes through a bvh either way
+        bool flat = n <= 64;
+
+        std::unique_ptr<hittable> objects;
+        if (flat)
+            objects = std::make_unique<hittable_list>(sphere_list(centers));
+        else
+            objects = std::make_unique<bvh>(sphere_list(centers));
+
+        sphere_soup soup;
+        int mat = soup.add_material(std::unique_ptr<material>( new lambertian(colour(0.5, 0.5, 0.5)) ));
+        for (const auto& center : centers)
+            soup.add(center, 0.2, mat);
+        if (!flat)
+            soup.build();
+
+        int hits;
+        double rate_objects = time_hits(*objects, rays, hits);
+        double rates[3];
+        for (int level = 0; level < 3; level++) {
+            auto simd = sphere_soup::simd_level(level);
+            if (level > int(sphere_soup::detect_simd())) {
+                rates[level] = 0;
+                continue;
+            }
+            soup.use_simd(simd);
+            rates[level] = time_hits(soup, rays, hits);
+        }
+
+        std::printf("  %7d  %-10s  %8.3f %8.3f %8.3f %8.3f\n", n, flat ? "flat" : "bvh",
+                    rate_objects / 1e6, rates[0] / 1e6, rates[1] / 1e6, rates[2] / 1e6);
+    }
+}
+
+// book scene as a bvh of sphere objects, the renderer's default setup
+std::unique_ptr<hittable> book_world() {
+    hittable_list world;
+    book_scene([&](const point3& center, double radius, const material_desc& m) {
+        world.emplace<sphere>(center, radius, world.make_material(m));
+    });
+    return std::make_unique<bvh>(std::move(world));
+}
+
+double mean_value(const framebuffer& image) {
+    double sum = 0;
+    size_t n = size_t(3) * image.width() * image.height();
+    for (size_t k = 0; k < n; k++)
+        sum += image.data()[k];
+    return sum / n;
+}
+
+// root mean square difference between two images of the same size
+double rms_difference(const framebuffer& a, const framebuffer& b) {
+    double sum = 0;
+    size_t n = size_t(3) * a.width() * a.height();
+    for (size_t k = 0; k < n; k++) {
+        double d = double(a.data()[k]) - b.data()[k];
+        sum += d * d;
+    }
+    return std::sqrt(sum / n);
+}
+
+// same, after the gamma the writers apply, which is closer to how different they look
+double rms_display_difference(const framebuffer& a, const framebuffer& b) {
+    double sum = 0;
+    size_t n = size_t(3) * a.width() * a.height();
+    for (size_t k = 0; k < n; k++) {
+        double d = linear_to_gamma(a.data()[k]) - linear_to_gamma(b.data()[k]);
+        sum += d * d;
+    }
+    return std::sqrt(sum / n);
+}
+
+void bench_integrator() {
+    std::cout << "integrator: recursive vs iterative with russian roulette, book scene 400px\n";
+    auto world = book_world();
+
+    camera cam;
+    book_camera(cam);
+    cam.image_width = 400;
+    cam.log_progress = false;
+
+    framebuffer images[2];
+    const char* names[2] = { "recursive", "iterative" };
+    for (int k = 0; k < 2; k++) {
+        cam.integrator = k == 0 ? integrator_type::recursive : integrator_type::iterative;
+        auto start = bench_clock::now();
+        images[k] = cam.render(*world);
+        std::printf("  %-10s %7.3f s\n", names[k], seconds_since(start));
+    }
+    // both are unbiased, so the means should agree and the difference be sample noise only
+    std::printf("  mean: %.4f vs %.4f, rms difference: %.4f\n",
+                mean_value(images[0]), mean_value(images[1]), rms_difference(images[0], images[1]));
+}
+
+void bench_adaptive() {
+    std::cout << "adaptive: fixed vs adaptive sampling, book scene 300px, error vs 256 spp reference\n";
+    auto world = book_world();
+
+    camera cam;
+    book_camera(cam);
+    cam.image_width = 300;
+    cam.log_progress = false;
+
+    // reference uses a different frame's seeds so its noise isn't shared with the test renders
+    cam.samples_per_pixel = 256;
+    cam.frame_index = 1;
+    framebuffer reference = cam.render(*world);
+    cam.frame_index = 0;
+
+    cam.samples_per_pixel = 64;
+    std::cout << "  mode                   time_s   avg_spp   rms_error (display units)\n";
+    for (double threshold : {0.0, 0.01, 0.005, 0.0025}) {
+        cam.adaptive = threshold > 0;
+        cam.adaptive_threshold = threshold;
+
+        auto start = bench_clock::now();
+        framebuffer image = cam.render(*world);
+        double elapsed = seconds_since(start);
+
+        double spp = cam.average_samples_taken();
+        char label[32];
+        if (cam.adaptive)
+            std::snprintf(label, sizeof(label), "adaptive %.4f", threshold);
+        else
+            std::snprintf(label, sizeof(label), "fixed 64 spp");
+        std::printf("  %-20s %8.3f %9.1f %11.5f\n", label, elapsed, spp, rms_display_difference(image, reference));
+    }
+}
+
+void bench_scene_file() {
+    std::cout << "scene_file: loading a million sphere scene, text vs binary\n";
+    const int n = 1000000;
+
+    scene_desc generated;
+    for (const auto& center : random_centers(n)) {
+        material_desc m;
+        // 64 distinct greys, so most spheres share a material
+        m.albedo = colour(1, 1, 1) * (int(random_double() * 64) / 64.0);
+        generated.add_sphere(center, 0.2, generated.add_material(m));
+    }
+
+    auto dir = std::filesystem::temp_directory_path();
+    std::string text_path = (dir / "rt_bench.scene").string();
+    std::string binary_path = (dir / "rt_bench.rtsb").string();
+
+    auto start = bench_clock::now();
+    save_text_scene(text_path, generated);
+    double save_text = seconds_since(start);
+    start = bench_clock::now();
+    std::string error;
+    if (!save_binary_scene(binary_path, generated, error)) {
+        std::cout << "  " << error << '\n';
+        return;
+    }
+    double save_binary = seconds_since(start);
+    std::printf("  saved text in %.3f s, binary (incl. bvh build) in %.3f s\n", save_text, save_binary);
+
+    for (const std::string& path : { text_path, binary_path }) {
+        scene_desc scene;
+        std::string error;
+        start = bench_clock::now();
+        if (!load_scene(path, scene, error)) {
+            std::cout << "  " << error << '\n';
+            continue;
+        }
+        double load = seconds_since(start);
+        size_t materials = scene.materials.size();
+
+        start = bench_clock::now();
+        auto world = scene.take_world();
+        double ready = seconds_since(start);
+
+        std::printf("  %-7s %7.1f MB  load %8.2f ms  to world (bvh) %8.2f ms  %zu spheres, %zu materials\n",
+                    path == text_path ? "text" : "binary",
+                    std::filesystem::file_size(path) / 1e6, 1000 * load, 1000 * ready, world->size(), materials);
+    }
+
+    std::remove(text_path.c_str());
+    std::remove(binary_path.c_str());
+}
+
+// bytes currently allocated from the heap, small blocks and mmapped ones
+size_t heap_in_use() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+void bench_arena() {
+    std::cout << "arena: per-object heap allocation vs scene arena, random spheres, 64 shared materials\n";
+    std::cout << "  objects  layout  bytes/object  build_ms  bvh_Mrays/s\n";
+
+    for (int n : {10000, 100000, 1000000}) {
+        auto centers = random_centers(n);
+        auto rays = patch_rays(n, 500000);
+        std::vector<colour> albedos(n);
+        for (auto& albedo : albedos)
+            albedo = colour(1, 1, 1) * (int(random_double() * 64) / 64.0);
+
+        for (bool use_arena : {false, true}) {
+            size_t heap_before = heap_in_use();
+            auto start = bench_clock::now();
+            hittable_list world;
+            for (int i = 0; i < n; i++) {
+                if (use_arena) {
+                    world.emplace<sphere>(centers[i], 0.2, world.make_material(material_desc::make_lambertian(albedos[i])));
+                } else {
+                    // the old layout: every sphere and its own copy of the material on the heap
+                    auto m = world.add_material(std::make_unique<lambertian>(albedos[i]));
+                    world.add(std::make_unique<sphere>(centers[i], 0.2, m));
+                }
+            }
+            double bytes = double(heap_in_use() - heap_before) / n;
+
+            bvh tree(std::move(world));
+            double build_ms = 1000 * seconds_since(start);
+
+            int hits;
+            double rate = time_hits(tree, rays, hits);
+            std::printf("  %7d  %-6s  %12.1f  %8.2f  %11.3f\n",
+                        n, use_arena ? "arena" : "heap", bytes, build_ms, rate / 1e6);
+        }
+    }
+}
+
+void bench_wavefront() {
+    std::cout << "wavefront: per-sample megakernel vs wavefront batches per tile, book scene 400px 32 spp\n";
+    std::cout << "  world    integrator   time_s  Msamples/s  rms vs iterative\n";
+
+    camera cam;
+    book_camera(cam);
+    cam.image_width = 400;
+    cam.samples_per_pixel = 32;
+    cam.log_progress = false;
+    double samples = double(cam.image_width) * cam.rendered_height() * cam.samples_per_pixel;
+
+    scene_desc soup_scene;
+    book_scene([&](const point3& center, double radius, const material_desc& m) {
+        soup_scene.add_sphere(center, radius, soup_scene.add_material(m));
+    });
+    auto objects = book_world();
+    auto soup = soup_scene.take_world();
+
+    for (const hittable* world : { objects.get(), static_cast<hittable*>(soup.get()) }) {
+        framebuffer images[2];
+        for (int k = 0; k < 2; k++) {
+            cam.integrator = k == 0 ? integrator_type::iterative : integrator_type::wavefront;
+            auto start = bench_clock::now();
+            images[k] = cam.render(*world);
+            double elapsed = seconds_since(start);
+            std::printf("  %-7s  %-10s  %7.3f  %10.3f  %16.6f\n", world == soup.get() ? "soup" : "bvh",
+                        k == 0 ? "iterative" : "wavefront", elapsed, samples / elapsed / 1e6,
+                        rms_difference(images[k], images[0]));
+        }
+    }
+}
+
+void bench_dispatch() {
+    std::cout << "dispatch: virtual vs closed-set (static) dispatch\n";
+
+    // scatter alone, over hits on a random mix of the book scene's materials
+    const int n = 1 << 16;
+    closed_world materials;
+    std::vector<hit_record> recs(n);
+    std::vector<ray> rays_in(n);
+    for (int k = 0; k < n; k++) {
+        double choose = random_double();
+        material_desc m = choose < 0.8 ? material_desc::make_lambertian(colour::random())
+                        : choose < 0.95 ? material_desc::make_metal(colour::random(0.5, 1), 0.1)
+                        : material_desc::make_dielectric(1.5);
+        recs[k].material_ptr = materials.add_material(m);
+        recs[k].p = point3(0, 0, 0);
+        rays_in[k] = ray(point3(0, 1, 1), vec3(0, -1, -1));
+        recs[k].set_face_normal(rays_in[k], vec3(0, 1, 0));
+    }
+
+    const int rounds = 200;
+    sampler stream;
+    double sum = 0;
+    for (bool closed : {false, true}) {
+        auto start = bench_clock::now();
+        for (int round = 0; round < rounds; round++) {
+            for (int k = 0; k < n; k++) {
+                colour attenuation;
+                ray scattered;
+                bool ok = closed ? scatter_closed(*recs[k].material_ptr, rays_in[k], recs[k], attenuation, scattered, stream)
+                                 : recs[k].material_ptr->scatter(rays_in[k], recs[k], attenuation, scattered, stream);
+                if (ok)
+                    sum += scattered.direction().x();
+            }
+        }
+        std::printf("  scatter %-8s %8.2f M/s\n", closed ? "switch" : "virtual", double(n) * rounds / seconds_since(start) / 1e6);
+    }
+    std::printf("  (checksum %f)\n", sum);
+
+    // whole renders, book scene 400px 16 spp
+    camera cam;
+    book_camera(cam);
+    cam.image_width = 400;
+    cam.samples_per_pixel = 16;
+    cam.log_progress = false;
+    double samples = double(cam.image_width) * cam.rendered_height() * cam.samples_per_pixel;
+
+    closed_world world;
+    book_scene([&](const point3& center, double radius, const material_desc& m) {
+        world.add(center, radius, m);
+    });
+    world.build();
+    auto objects = book_world();
+
+    auto report = [&](const char* label, auto&& render) {
+        auto start = bench_clock::now();
+        render();
+        double elapsed = seconds_since(start);
+        std::printf("  render %-36s %7.3f s %7.3f Msamples/s\n", label, elapsed, samples / elapsed / 1e6);
+    };
+    report("bvh of sphere objects (virtual)", [&] { cam.render(*objects); });
+    report("closed world as hittable& (virtual)", [&] { cam.render(static_cast<const hittable&>(world)); });
+    report("closed world as itself (static)", [&] { cam.render(world); });
+}
+
+// the other precision's build can't be linked in, so each build leaves its render in the temp
+// dir and compares against the other one's if it's there
+void bench_precision() {
+    const char* name = std::is_same_v<real, float> ? "float" : "double";
+    const char* other = std::is_same_v<real, float> ? "double" : "float";
+    std::printf("precision: %s math core, book scene 400px 32 spp (run both image_benchmark builds to compare)\n", name);
+    std::printf("  sizeof vec3 %zu, ray %zu, hit_record %zu, sphere %zu\n",
+                sizeof(vec3), sizeof(ray), sizeof(hit_record), sizeof(sphere));
+
+    camera cam;
+    book_camera(cam);
+    cam.image_width = 400;
+    cam.samples_per_pixel = 32;
+    cam.log_progress = false;
+    double samples = double(cam.image_width) * cam.rendered_height() * cam.samples_per_pixel;
+
+    closed_world world;
+    book_scene([&](const point3& center, double radius, const material_desc& m) {
+        world.add(center, radius, m);
+    });
+    world.build();
+
+    auto start = bench_clock::now();
+    framebuffer image = cam.render(world);
+    double elapsed = seconds_since(start);
+    std::printf("  %-6s %7.3f s %7.3f Msamples/s, mean %.5f\n", name, elapsed, samples / elapsed / 1e6, mean_value(image));
+
+    auto dir = std::filesystem::temp_directory_path();
+    auto path_for = [&](const char* precision) { return dir / (std::string("rt_precision_") + precision + ".raw"); };
+    size_t floats = size_t(3) * image.width() * image.height();
+    {
+        std::ofstream out(path_for(name), std::ios::binary);
+        out.write(reinterpret_cast<const char*>(image.data()), std::streamsize(floats * sizeof(float)));
+    }
+
+    std::ifstream in(path_for(other), std::ios::binary);
+    if (!in || std::filesystem::file_size(path_for(other)) != floats * sizeof(float)) {
+        std::printf("  no %s render to compare with yet\n", other);
+        return;
+    }
+    framebuffer theirs(image.width(), image.height());
+    in.read(reinterpret_cast<char*>(theirs.data()), std::streamsize(floats * sizeof(float)));
+    std::printf("  vs %s: mean %.5f, rms difference %.5f linear, %.5f display\n", other,
+                mean_value(theirs), rms_difference(image, theirs), rms_display_difference(image, theirs));
+}
+
+// a short turntable of the book scene, rendered as separate runs of image_renderer would do
+// it (the scene built, threads started and the frame written, one after the other for every
+// frame) and as one batch with render_animation
+void bench_animation() {
+    const int frames = 8;
+    std::printf("animation: %d frame turntable of the book scene, 320px 4 spp, png per frame\n", frames);
+
+    camera cam;
+    book_camera(cam);
+    cam.image_width = 320;
+    cam.samples_per_pixel = 4;
+    cam.log_progress = false;
+    camera_path path = orbit(cam, frames);
+
+    auto dir = std::filesystem::temp_directory_path();
+    auto write_frame = [&](int frame, const framebuffer& image) {
+        std::ofstream out(dir / frame_path("rt_animation_####.png", frame), std::ios::binary);
+        write_image(out, image, image_format::png);
+        return bool(out);
+    };
+    auto build = [](closed_world& world) {
+        book_scene([&](const point3& center, double radius, const material_desc& m) { world.add(center, radius, m); });
+        world.build();
+    };
+
+    auto start = bench_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        closed_world world;
+        build(world);
+        path.apply(cam, frame);
+        cam.frame_index = frame;
+        write_frame(frame, cam.render(world));
+    }
+    double separate = seconds_since(start);
+
+    start = bench_clock::now();
+    closed_world world;
+    build(world);
+    render_animation(cam, path, 0, frames, world, write_frame);
+    double batch = seconds_since(start);
+
+    std::printf("  %-34s %7.3f s %7.2f frames/s\n", "per frame setup, write then render", separate, frames / separate);
+    std::printf("  %-34s %7.3f s %7.2f frames/s\n", "batch, write overlapping render", batch, frames / batch);
+
+    for (int frame = 0; frame < frames; frame++)
+        std::filesystem::remove(dir / frame_path("rt_animation_####.png", frame));
+}
+
+// motion blur from one render with an open shutter, against the same scene still and against
+// averaging whole renders at instants through the shutter (what blur took before rays had a
+// time)
+void bench_motion() {
+    const int instants = 8;
+    std::printf("motion: bouncing book scene, 400px 16 spp, against %d renders at instants\n", instants);
+
+    camera cam;
+    bouncing_camera(cam);
+    cam.image_width = 400;
+    cam.samples_per_pixel = 16;
+    cam.log_progress = false;
+    double samples = double(cam.image_width) * cam.rendered_height() * cam.samples_per_pixel;
+
+    closed_world still, bouncing;
+    book_scene([&](const point3& center, double radius, const material_desc& m) { still.add(center, radius, m); });
+    bouncing_scene([&](const point3& center, double radius, const material_desc& m) { bouncing.add(center, radius, m); },
+                   [&](const point3& center0, const point3& center1, double radius, const material_desc& m) {
+                       bouncing.add_moving(center0, center1, radius, m);
+                   });
+    still.build();
+    bouncing.build();
+
+    auto report = [&](const char* label, double elapsed) {
+        std::printf("  %-32s %7.3f s %7.3f Msamples/s\n", label, elapsed, samples / elapsed / 1e6);
+    };
+
+    auto start = bench_clock::now();
+    cam.render(still);
+    report("still scene", seconds_since(start));
+
+    start = bench_clock::now();
+    framebuffer blurred = cam.render(bouncing);
+    report("open shutter, one render", seconds_since(start));
+
+    start = bench_clock::now();
+    camera instant = cam;
+    framebuffer averaged(blurred.width(), blurred.height());
+    for (int k = 0; k < instants; k++) {
+        instant.shutter_open = instant.shutter_close = (k + 0.5) / instants;
+        instant.frame_index = k;
+        framebuffer frame = instant.render(bouncing);
+        for (int j = 0; j < frame.height(); j++)
+            for (int i = 0; i < frame.width(); i++)
+                averaged.set(i, j, averaged.get(i, j) + frame.get(i, j) / instants);
+    }
+    double elapsed = seconds_since(start);
+    std::printf("  %-32s %7.3f s (%d renders)\n", "averaged instants", elapsed, instants);
+    std::printf("  rms difference between the two blurs %.5f linear\n", rms_difference(blurred, averaged));
+}
+
+void bench_lights() {
+    std::cout << "lights: cornell box 100px, path tracing alone vs with light sampling (nee + mis),\n"
+                 "        error vs a 1024 spp reference\n";
+    closed_world world;
+    cornell_scene([&](const point3& center, double radius, const material_desc& m) { world.add(center, radius, m); },
+                  [&](const point3& q, const vec3& u, const vec3& v, const material_desc& m) { world.add_quad(q, u, v, m); });
+    world.build();
+
+    camera cam;
+    cornell_camera(cam);
+    cam.image_width = 100;
+    cam.log_progress = false;
+    cam.lights = &world.lights();
+
+    // reference uses a different frame's seeds so its noise isn't shared with the test renders
+    cam.samples_per_pixel = 1024;
+    cam.frame_index = 1;
+    framebuffer reference = cam.render(world);
+    cam.frame_index = 0;
+
+    // error falls as 1/sqrt(spp), so the square of the error ratio is how many times the
+    // samples path tracing alone needs to get down to the same noise
+    std::cout << "  spp   path_s  path_rms   nee_s   nee_rms   samples for equal noise\n";
+    for (int spp : {4, 16, 64, 256}) {
+        cam.samples_per_pixel = spp;
+        double seconds[2], error[2];
+        for (int k = 0; k < 2; k++) {
+            cam.lights = k == 0 ? nullptr : &world.lights();
+            auto start = bench_clock::now();
+            framebuffer image = cam.render(world);
+            seconds[k] = seconds_since(start);
+            error[k] = rms_display_difference(image, reference);
+        }
+        double ratio = (error[0] / error[1]) * (error[0] / error[1]);
+        std::printf("  %3d %8.3f %9.5f %7.3f %9.5f %8.1fx (%.1fx in time)\n", spp, seconds[0], error[0],
+                    seconds[1], error[1], ratio, ratio * seconds[0] / seconds[1]);
+    }
+
+    // the same room lit by n small sphere lights of the same total power instead: the alias
+    // table picks one in constant time, so what time grows with n is the lights as geometry,
+    // a deeper bvh for every ray
+    std::cout << "  many lights, 100px 16 spp:\n     lights   time_s  table_bytes\n";
+    cam.samples_per_pixel = 16;
+    for (int n : {1, 16, 256, 4096, 65536}) {
+        closed_world room;
+        cornell_scene([&](const point3& center, double radius, const material_desc& m) {
+                          if (m.type != material_desc::kind::emissive)
+                              room.add(center, radius, m);
+                      },
+                      [&](const point3& q, const vec3& u, const vec3& v, const material_desc& m) {
+                          if (m.type != material_desc::kind::emissive)
+                              room.add_quad(q, u, v, m);
+                      });
+        pcg32 rng(17, 0);
+        double radius = 4;
+        colour emit = colour(1, 1, 1) * (15 * 130 * 105 / (2 * pi * radius * radius) / n);
+        for (int k = 0; k < n; k++) {
+            point3 center(random_double(rng, 50, 505), random_double(rng, 450, 540), random_double(rng, 50, 505));
+            room.add(center, radius, material_desc::make_emissive(emit));
+        }
+        room.build();
+        cam.lights = &room.lights();
+
+        auto start = bench_clock::now();
+        cam.render(room);
+        std::printf("  %9d %8.3f %12zu\n", n, seconds_since(start), room.lights().bytes());
+    }
+}
+
+void bench_sampler() {
+    std::cout << "sampler: error vs spp for each sampler, against a 1024 spp sobol reference\n";
+    const sampler_type types[] = { sampler_type::independent, sampler_type::stratified, sampler_type::sobol, sampler_type::blue_noise };
+    const char* names[] = { "independent", "stratified", "sobol", "blue_noise" };
+
+    closed_world book, cornell;
+    book_scene([&](const point3& center, double radius, const material_desc& m) { book.add(center, radius, m); });
+    cornell_scene([&](const point3& center, double radius, const material_desc& m) { cornell.add(center, radius, m); },
+                  [&](const point3& q, const vec3& u, const vec3& v, const material_desc& m) { cornell.add_quad(q, u, v, m); });
+    book.build();
+    cornell.build();
+
+    auto run = [&](const char* title, camera cam, const closed_world& world) {
+        cam.log_progress = false;
+        // the reference's scrambles come from a different frame, so it shares no noise with
+        // the test renders
+        cam.sampling = sampler_type::sobol;
+        cam.samples_per_pixel = 1024;
+        cam.frame_index = 1;
+        framebuffer reference = cam.render(world);
+        cam.frame_index = 0;
+
+        std::printf("  %s, rms error (display units):\n    spp", title);
+        for (const char* name : names)
+            std::printf(" %12s", name);
+        std::printf("\n");
+        double error_at_64[4] = {}, seconds_at_64[4] = {};
+        for (int spp : {1, 4, 16, 64}) {
+            std::printf("  %5d", spp);
+            for (int k = 0; k < 4; k++) {
+                cam.sampling = types[k];
+                cam.samples_per_pixel = spp;
+                auto start = bench_clock::now();
+                framebuffer image = cam.render(world);
+                double seconds = seconds_since(start);
+                double error = rms_display_difference(image, reference);
+                std::printf(" %12.5f", error);
+                error_at_64[k] = error;
+                seconds_at_64[k] = seconds;
+            }
+            std::printf("\n");
+        }
+        // independent samples' error falls as 1/sqrt(spp), so squaring the error ratio gives
+        // the samples it needs to match the others
+        std::printf("  independent spp for the same error as 64 spp of each (time per spp vs independent):\n   ");
+        for (int k = 0; k < 4; k++) {
+            double ratio = error_at_64[0] / error_at_64[k];
+            std::printf(" %s %.0f (%.2fx)", names[k], 64 * ratio * ratio, seconds_at_64[k] / seconds_at_64[0]);
+        }
+        std::printf("\n");
+    };
+
+    camera cam;
+    book_camera(cam);
+    cam.image_width = 160;
+    run("book scene 160px", cam, book);
+
+    cornell_camera(cam);
+    cam.image_width = 100;
+    cam.lights = &cornell.lights();
+    run("cornell box 100px with light sampling", cam, cornell);
+}
+
+void bench_denoise() {
+    std::cout << "denoise: rms error against a 1024 spp reference, before and after denoising\n";
+    closed_world book, cornell;
+    book_scene([&](const point3& center, double radius, const material_desc& m) { book.add(center, radius, m); });
+    cornell_scene([&](const point3& center, double radius, const material_desc& m) { cornell.add(center, radius, m); },
+                  [&](const point3& q, const vec3& u, const vec3& v, const material_desc& m) { cornell.add_quad(q, u, v, m); });
+    book.build();
+    cornell.build();
+
+    auto run = [&](const char* title, camera cam, const closed_world& world) {
+        cam.log_progress = false;
+        cam.samples_per_pixel = 1024;
+        cam.frame_index = 1; // noise of its own
+        framebuffer reference = cam.render(world);
+        cam.frame_index = 0;
+
+        std::printf("  %s:\n    spp   noisy rms  denoised rms  denoise ms\n", title);
+        double noisy_at_8 = 0, denoised_at_8 = 0;
+        denoiser filter;
+        aov_buffers aovs;
+        cam.aovs = &aovs;
+        for (int spp : {4, 8, 16, 32, 128}) {
+            cam.samples_per_pixel = spp;
+            framebuffer image = cam.render(world);
+            auto start = bench_clock::now();
+            framebuffer denoised = filter.denoise(image, aovs);
+            double ms = 1000 * seconds_since(start);
+            double noisy = rms_display_difference(image, reference);
+            double clean = rms_display_difference(denoised, reference);
+            std::printf("  %5d %11.5f %13.5f %11.1f\n", spp, noisy, clean, ms);
+            if (spp == 8) {
+                noisy_at_8 = noisy;
+                denoised_at_8 = clean;
+            }
+        }
+        // noise falls as 1/sqrt(spp), so this many would match 8 denoised; the 128 row checks it
+        double ratio = noisy_at_8 / denoised_at_8;
+        std::printf("  8 spp denoised is as close to the reference as about %.0f spp without\n", 8 * ratio * ratio);
+    };
+
+    camera cam;
+    book_camera(cam);
+    cam.image_width = 240;
+    run("book scene 240px", cam, book);
+
+    cornell_camera(cam);
+    cam.image_width = 160;
+    cam.lights = &cornell.lights();
+    run("cornell box 160px with light sampling", cam, cornell);
+
+    // the filter alone at full size, on every thread
+    book_camera(cam);
+    cam.log_progress = false;
+    cam.samples_per_pixel = 1;
+    aov_buffers aovs;
+    cam.aovs = &aovs;
+    framebuffer image = cam.render(book);
+    denoiser filter;
+    for (int threads = 1; threads <= default_thread_count(); threads *= 2) {
+        filter.thread_count = threads;
+        filter.denoise(image, aovs); // warm
+        auto start = bench_clock::now();
+        filter.denoise(image, aovs);
+        double seconds = seconds_since(start);
+        std::printf("  %dx%d on %d threads: %.1f ms, %.1f ns per pixel per pass\n", image.width(), image.height(), threads,
+                    1000 * seconds, 1e9 * seconds / (double(image.width()) * image.height() * filter.iterations));
+    }
+}
+
+// writes a bumpy sphere of about n triangles as an obj file of quads: a stand-in for scanned
+// models like the stanford bunny (69k triangles) or the happy buddha (1.1M)
+void write_bumpy_sphere_obj(const std::string& path, int n) {
+    int rows = std::max(4, int(std::sqrt(n / 2.0)));
+    std::ofstream out(path);
+    out << "# bumpy sphere, " << 2 * rows * rows << " triangles\n";
+    for (int j = 0; j <= rows; j++) {
+        double theta = pi * j / rows;
+        for (int i = 0; i < rows; i++) {
+            double phi = 2 * pi * i / rows;
+            double r = 1 + 0.08 * std::sin(7 * theta) * std::sin(9 * phi) + 0.03 * std::sin(23 * theta + 3 * phi);
+            out << "v " << r * std::sin(theta) * std::cos(phi) << ' ' << r * std::cos(theta) << ' '
+                << r * std::sin(theta) * std::sin(phi) << '\n';
+        }
+    }
+    for (int j = 0; j < rows; j++) {
+        for (int i = 0; i < rows; i++) {
+            int a = j * rows + i + 1, b = j * rows + (i + 1) % rows + 1;
+            out << "f " << a << ' ' << b << ' ' << b + rows << ' ' << a + rows << '\n';
+        }
+    }
+}
+
+// obj loading, mesh bvh build and rendering, for a bunny sized and a buddha sized model
+void bench_mesh() {
+    std::cout << "mesh: obj load, bvh build and render of a triangle mesh, 400px 8 spp\n";
+    std::string path = (std::filesystem::temp_directory_path() / "rt_bench_mesh.obj").string();
+
+    for (int n : { 70000, 1000000 }) {
+        write_bumpy_sphere_obj(path, n);
+        double megabytes = std::filesystem::file_size(path) / 1e6;
+
+        auto mesh = std::make_unique<triangle_mesh>();
+        std::string error;
+        auto start = bench_clock::now();
+        if (!load_obj(path, *mesh, error)) {
+            std::cout << "  " << error << '\n';
+            return;
+        }
+        double load = seconds_since(start);
+
+        start = bench_clock::now();
+        mesh->build();
+        double build = seconds_since(start);
+
+        size_t triangles = mesh->triangle_count();
+        std::printf("  %8zu triangles  load %7.1f ms (%6.1f MB/s)  bvh %7.1f ms  %5.1f bytes/triangle\n",
+                    triangles, 1000 * load, megabytes / load, 1000 * build, double(mesh->bytes()) / triangles);
+
+        hittable_list list;
+        mesh->set_material(list.make_material(material_desc::make_metal(colour(0.8, 0.6, 0.4), 0.1)));
+        list.add(std::move(mesh));
+        list.emplace<sphere>(point3(0, -1001, 0), 1000, list.make_material(material_desc::make_lambertian(colour(0.5, 0.5, 0.5))));
+        bvh world(std::move(list));
+
+        camera cam;
+        cam.aspect_ratio = 16.0 / 9.0;
+        cam.image_width = 400;
+        cam.samples_per_pixel = 8;
+        cam.max_depth = 50;
+        cam.vfov = 30;
+        cam.lookfrom = point3(0, 1.5, 5);
+        cam.lookat = point3(0, 0, 0);
+        cam.log_progress = false;
+        cam.render(world);
+        const render_stats& stats = cam.stats();
+        std::printf("  %8s render %7.3f s  %6.2f Mrays/s  %5.1f nodes, %5.1f triangles tested per ray\n", "",
+                    stats.render_seconds, stats.total_rays() / stats.render_seconds / 1e6,
+                    double(stats.totals.node_tests) / stats.total_rays(),
+                    double(stats.totals.primitive_tests) / stats.total_rays());
+    }
+    std::filesystem::remove(path);
+}
+
+// a million copies of one small mesh over the dense_scene square, each turned and sized at
+// random, as instances under a top-level bvh. copies are only counted, not made.
+void bench_instance() {
+    const int n = 1000000;
+    std::cout << "instance: 1M instances of a 1k triangle mesh, 400px 4 spp\n";
+
+    std::string path = (std::filesystem::temp_directory_path() / "rt_bench_instance.obj").string();
+    write_bumpy_sphere_obj(path, 1000);
+    auto mesh = std::make_unique<triangle_mesh>();
+    std::string error;
+    if (!load_obj(path, *mesh, error)) {
+        std::cout << "  " << error << '\n';
+        return;
+    }
+    std::filesystem::remove(path);
+    mesh->build();
+    size_t mesh_bytes = mesh->bytes();
+
+    size_t heap_before = heap_in_use();
+    auto start = bench_clock::now();
+    hittable_list list;
+    const hittable* geometry = list.keep(std::move(mesh));
+    pcg32 rng(5, 0);
+    double side = std::sqrt(double(n));
+    for (int k = 0; k < n; k++) {
+        point3 center(side * (random_double(rng) - 0.5), 0.2, side * (random_double(rng) - 0.5));
+        double size = random_double(rng, 0.15, 0.25);
+        affine place = affine::translate(center) * affine::rotate(vec3(0, 1, 0), random_double(rng, 0, 360)) * affine::scale(size);
+        auto m = list.make_material(material_desc::make_lambertian(colour(1, 1, 1) * (int(random_double(rng) * 16) / 16.0)));
+        list.emplace<instance>(geometry, place, m);
+    }
+    list.emplace<sphere>(point3(0, -1000, 0), 1000, list.make_material(material_desc::make_lambertian(colour(0.5, 0.5, 0.5))));
+    bvh world(std::move(list));
+    double build = seconds_since(start);
+    size_t bytes = heap_in_use() - heap_before;
+
+    std::printf("  instances + top bvh %8.1f MB (%5.1f bytes each), built in %.2f s\n", bytes / 1e6, double(bytes) / n, build);
+    std::printf("  copies would take   %8.1f MB (%5.0f bytes each), %.2f%% of that\n",
+                double(mesh_bytes) * n / 1e6, double(mesh_bytes), 100.0 * bytes / (double(mesh_bytes) * n));
+
+    camera cam;
+    dense_camera(cam, n);
+    cam.samples_per_pixel = 4;
+    cam.log_progress = false;
+    cam.render(world);
+    const render_stats& stats = cam.stats();
+    std::printf("  render %7.3f s  %6.2f Mrays/s\n", stats.render_seconds, stats.total_rays() / stats.render_seconds / 1e6);
+}
+
+// what sphere and hittable_list did before hits were split into intersect and surface,
+// kept to compare against: every hit closer than the ones before it gets its whole surface
+// worked out, and the list copies each one into the result. counts the surfaces it works out.
+class eager_sphere final : public hittable {
+  public:
+    static inline uint64_t surfaces = 0;
+
+    eager_sphere(const point3& center, real radius, const material* material_ptr)
+        : center(center), radius(radius), material_ptr(material_ptr) {}
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (!hit_sphere(center, radius, r, ray_t, rec.t))
+            return false;
+        rec.object = this;
+        sphere_surface(center, radius, material_ptr, r, rec);
+        surfaces++;
+        return true;
+    }
+
+    aabb bounding_box() const override {
+        vec3 rvec(radius, radius, radius);
+        return aabb(center - rvec, center + rvec);
+    }
+
+  private:
+    point3 center;
+    real radius;
+    const material* material_ptr;
+};
+
+class eager_list final : public hittable {
+  public:
+    explicit eager_list(const hittable_list& list) : list(list) {}
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        hit_record temp_rec;
+        bool hit_anything = false;
+        auto closest_so_far = ray_t.max;
+        for (const auto& object : list.objects) {
+            if (object->intersect(r, {ray_t.min, closest_so_far}, temp_rec)) {
+                hit_anything = true;
+                closest_so_far = temp_rec.t;
+                rec = temp_rec;
+            }
+        }
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return list.bounding_box(); }
+
+  private:
+    const hittable_list& list;
+};
+
+// n spheres of radius 0.2 through a cube, dense enough that a ray crossing it passes through
+// about as many spheres as the cube is wide, each of which can be the closest so far
+template <typename Sphere>
+hittable_list sphere_cube(int n) {
+    pcg32 rng(7, 0);
+    double side = 0.5 * std::cbrt(double(n));
+    hittable_list world;
+    const material* m = world.make_material(material_desc::make_lambertian(colour(0.5, 0.5, 0.5)));
+    for (int i = 0; i < n; i++) {
+        point3 center(side * (random_double(rng) - 0.5), side * (random_double(rng) - 0.5), side * (random_double(rng) - 0.5));
+        world.emplace<Sphere>(center, 0.2, m);
+    }
+    return world;
+}
+
+// rays into the cube from points round it, aimed at random points inside
+std::vector<ray> cube_rays(int n_objects, int n_rays) {
+    pcg32 rng(8, 0);
+    double side = 0.5 * std::cbrt(double(n_objects));
+    std::vector<ray> rays;
+    rays.reserve(n_rays);
+    for (int i = 0; i < n_rays; i++) {
+        point3 origin = 1.5 * side * random_unit_vector(rng);
+        point3 target(0.3 * side * (random_double(rng) - 0.5), 0.3 * side * (random_double(rng) - 0.5), 0.3 * side * (random_double(rng) - 0.5));
+        rays.emplace_back(origin, target - origin);
+    }
+    return rays;
+}
+
+void bench_deferred() {
+    std::cout << "deferred: surfaces worked out for every closer hit (eager) vs once for the closest (deferred)\n";
+    // the eager list writes a whole record and copies it for each closer hit; intersect only
+    // writes t, the object and the primitive. the closest hit's surface is stored once either way
+    const double eager_bytes = 2.0 * sizeof(hit_record);
+    const double deferred_bytes = sizeof(real) + sizeof(const hittable*) + sizeof(int32_t);
+    std::printf("  sizeof hit_record %zu, of what intersect stores %zu\n", sizeof(hit_record), size_t(deferred_bytes));
+    std::cout << "  scene             closer hits  surfaces/ray       stored bytes/ray       Mrays/s\n"
+                 "                    per ray      eager  deferred   eager  deferred     eager  deferred  speedup\n";
+
+    auto compare = [&](const char* name, const hittable& eager, const hittable& deferred, const std::vector<ray>& rays) {
+        int eager_hits, deferred_hits;
+        eager_sphere::surfaces = 0;
+        double eager_rate = time_hits(eager, rays, eager_hits);
+        double candidates = double(eager_sphere::surfaces) / rays.size(); // intersect finds the same ones
+        double deferred_rate = time_hits(deferred, rays, deferred_hits);
+        double surfaces = double(deferred_hits) / rays.size();
+        std::printf("  %-16s  %11.2f  %6.2f  %8.2f  %6.0f  %8.0f  %8.3f  %8.3f  %6.2fx%s\n", name, candidates,
+                    candidates, surfaces, candidates * eager_bytes, candidates * deferred_bytes + surfaces * sizeof(hit_record),
+                    eager_rate / 1e6, deferred_rate / 1e6, deferred_rate / eager_rate,
+                    eager_hits == deferred_hits ? "" : "  (hit counts differ!)");
+    };
+
+    for (int n : { 1000, 10000 }) {
+        auto eager_spheres = sphere_cube<eager_sphere>(n);
+        auto spheres = sphere_cube<sphere>(n);
+        auto rays = cube_rays(n, std::max(2000, 20000000 / n));
+        char name[32];
+        std::snprintf(name, sizeof name, "list %d", n);
+        compare(name, eager_list(eager_spheres), spheres, rays);
+    }
+    for (int n : { 10000, 1000000 }) {
+        bvh eager(sphere_cube<eager_sphere>(n));
+        bvh deferred(sphere_cube<sphere>(n));
+        auto rays = cube_rays(n, 500000);
+        char name[32];
+        std::snprintf(name, sizeof name, "bvh %d", n);
+        compare(name, eager, deferred, rays);
+    }
+
+    // whole renders, book scene 400px 16 spp, where most rays are camera rays or bounces
+    camera cam;
+    book_camera(cam);
+    cam.image_width = 400;
+    cam.samples_per_pixel = 16;
+    cam.log_progress = false;
+    double samples = double(cam.image_width) * cam.rendered_height() * cam.samples_per_pixel;
+    hittable_list eager_book, book;
+    book_scene([&](const point3& center, double radius, const material_desc& m) {
+        eager_book.emplace<eager_sphere>(center, radius, eager_book.make_material(m));
+        book.emplace<sphere>(center, radius, book.make_material(m));
+    });
+    bvh eager(std::move(eager_book)), deferred(std::move(book));
+    for (const hittable* world : { static_cast<const hittable*>(&eager), static_cast<const hittable*>(&deferred) }) {
+        auto start = bench_clock::now();
+        cam.render(*world);
+        double elapsed = seconds_since(start);
+        std::printf("  render book %-8s %7.3f s  %7.3f Msamples/s\n", world == &eager ? "eager" : "deferred",
+                    elapsed, samples / elapsed / 1e6);
+    }
+}
+
+// one canonical scene of the report: a world and a camera set up to render it
+struct report_scene {
+    std::string name;
+    std::unique_ptr<closed_world> world;
+    camera cam;
+};
+
+template <typename Scene>
+report_scene make_report_scene(std::string name, Scene&& fill) {
+    report_scene s;
+    s.name = std::move(name);
+    s.world = std::make_unique<closed_world>();
+    fill(*s.world, s.cam);
+    s.world->build();
+    s.cam.log_progress = false;
+    s.cam.frame_index = 0; // fixed seeds, so runs are comparable
+    return s;
+}
+
+// renders the canonical scenes and prints one json object to stdout, for tracking
+// performance over time: e.g. image_benchmark report > report.json
+void bench_report() {
+    auto add_to = [](closed_world& world) {
+        return [&world](const point3& center, double radius, const material_desc& m) { world.add(center, radius, m); };
+    };
+
+    std::vector<report_scene> scenes;
+    for (int width : {200, 400, 800}) {
+        scenes.push_back(make_report_scene("book_" + std::to_string(width), [&](closed_world& world, camera& cam) {
+            book_scene(add_to(world));
+            book_camera(cam);
+            cam.image_width = width;
+            cam.samples_per_pixel = 16;
+        }));
+    }
+    scenes.push_back(make_report_scene("dense_10000", [&](closed_world& world, camera& cam) {
+        dense_scene(add_to(world), 10000);
+        dense_camera(cam, 10000);
+    }));
+    scenes.push_back(make_report_scene("glass", [&](closed_world& world, camera& cam) {
+        glass_scene(add_to(world));
+        book_camera(cam);
+        cam.image_width = 400;
+        cam.samples_per_pixel = 16;
+    }));
+
+    std::printf("{\n  \"precision\": \"%s\",\n  \"hardware_threads\": %u,\n  \"scenes\": [",
+                std::is_same_v<real, float> ? "float" : "double", std::thread::hardware_concurrency());
+
+    for (size_t n = 0; n < scenes.size(); n++) {
+        auto& s = scenes[n];
+
+        // throughput from an untimed render, the bounce breakdown from a second, timed one
+        s.cam.time_bounces = false;
+        s.cam.render(*s.world);
+        render_stats stats = s.cam.stats();
+        s.cam.time_bounces = true;
+        s.cam.render(*s.world);
+        const render_stats& timed = s.cam.stats();
+
+        double seconds = stats.render_seconds;
+        double rays = double(stats.total_rays());
+        std::printf("%s\n    {\n", n == 0 ? "" : ",");
+        std::printf("      \"name\": \"%s\",\n", s.name.c_str());
+        std::printf("      \"width\": %d, \"height\": %d, \"samples_per_pixel\": %d, \"primitives\": %zu,\n",
+                    s.cam.image_width, s.cam.rendered_height(), s.cam.samples_per_pixel, s.world->size());
+        std::printf("      \"render_seconds\": %.6g,\n", seconds);
+        std::printf("      \"primary_rays\": %llu, \"secondary_rays\": %llu,\n",
+                    (unsigned long long)stats.primary_rays(), (unsigned long long)stats.secondary_rays());
+        std::printf("      \"primary_rays_per_second\": %.6g, \"secondary_rays_per_second\": %.6g, \"rays_per_second\": %.6g,\n",
+                    stats.primary_rays() / seconds, stats.secondary_rays() / seconds, rays / seconds);
+        std::printf("      \"node_tests_per_ray\": %.6g, \"primitive_tests_per_ray\": %.6g,\n",
+                    stats.totals.node_tests / rays, stats.totals.primitive_tests / rays);
+
+        std::printf("      \"bounces\": [");
+        for (int d = 0; d < timed.depth_count(); d++) {
+            std::printf("%s\n        { \"depth\": %d, \"rays\": %llu, \"seconds\": %.6g }", d == 0 ? "" : ",",
+                        d, (unsigned long long)timed.totals.rays_at_depth[d], timed.totals.seconds_at_depth[d]);
+        }
+        std::printf("\n      ],\n");
+
+        std::printf("      \"threads\": [");
+        for (size_t t = 0; t < stats.threads.size(); t++) {
+            const auto& use = stats.threads[t];
+            std::printf("%s\n        { \"tiles\": %d, \"busy_seconds\": %.6g, \"utilisation\": %.4f }",
+                        t == 0 ? "" : ",", use.tiles, use.busy_seconds, use.busy_seconds / seconds);
+        }
+        std::printf("\n      ]\n    }");
+    }
+    std::printf("\n  ]\n}\n");
+}
+
+struct suite {
+    const char* name;
+    void (*run)();
+};
+
+const suite suites[] = {
+    { "bvh", bench_bvh },
+    { "rng", bench_rng },
+    { "soup", bench_soup },
+    { "integrator", bench_integrator },
+    { "adaptive", bench_adaptive },
+    { "scene_file", bench_scene_file },
+    { "arena", bench_arena },
+    { "wavefront", bench_wavefront },
+    { "dispatch", bench_dispatch },
+    { "precision", bench_precision },
+    { "animation", bench_animation },
+    { "motion", bench_motion },
+    { "lights", bench_lights },
+    { "sampler", bench_sampler },
+    { "denoise", bench_denoise },
+    { "mesh", bench_mesh },
+    { "instance", bench_instance },
+    { "deferred", bench_deferred },
+    { "report", bench_report },
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    bool ran = false;
+    for (const auto& s : suites) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; i++)
+            if (std::strcmp(argv[i], s.name) == 0)
+                selected = true;
+        if (selected) {
+            s.run();
+            ran = true;
+        }
+    }
+
+    if (!ran) {
+        std::cerr << "unknown suite, available:";
+        for (const auto& s : suites)
+            std::cerr << ' ' << s.name;
+        std::cerr << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,340 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <vector>
+
+/*
+Flattened bounding volume hierarchy node.
+Nodes are laid out depth first, so an interior node's left child is always the next node
+in the array and only the right child index needs storing.
+*/
+struct bvh_node {
+    aabb bbox;
+    int  first; // leaf: index of first primitive, interior: index of right child
+    int  count; // number of primitives in a leaf, 0 for interior nodes
+    int  axis;  // split axis, lets traversal visit the nearer child first
+};
+
+/*
+Builds and traverses a bvh over a set of primitive boxes, independent of what the
+primitives actually are. Splits are chosen with a binned surface area heuristic (SAH).
+*/
+class bvh_tree {
+  public:
+    std::vector<bvh_node> nodes;
+
+    // builds the tree and returns the primitive order the leaves refer to, i.e. a leaf
+    // covers order[first] .. order[first+count-1]. owners reorder their primitives by this
+    // so each leaf is a contiguous run.
+    // prim_cost is the cost of one primitive test relative to visiting a node; primitives
+    // tested several at a time are cheaper, which makes the SAH favour fuller leaves.
+    std::vector<int> build(const std::vector<aabb>& boxes, int max_leaf_size = 4, double prim_cost = 1.0) {
+        this->prim_cost = prim_cost;
+        nodes.clear();
+        std::vector<int> order(boxes.size());
+        if (boxes.empty())
+            return order;
+
+        for (size_t i = 0; i < boxes.size(); i++)
+            order[i] = int(i);
+
+        std::vector<point3> centroids(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++)
+            centroids[i] = boxes[i].centroid();
+
+        nodes.reserve(2 * boxes.size());
+        build_node(boxes, centroids, order, 0, int(boxes.size()), 0, max_leaf_size);
+        nodes.shrink_to_fit();
+        return order;
+    }
+
+    aabb bounding_box() const {
+        return nodes.empty() ? aabb::empty : nodes[0].bbox;
+    }
+
+    // whether nodes read from outside (see scene_file.h) are a tree traverse can walk: every
+    // leaf's primitives in [0, primitive_count), every child after its parent and in the
+    // array, and no deeper than the traversal stack
+    static bool valid(const std::vector<bvh_node>& nodes, size_t primitive_count) {
+        std::vector<int> depth(nodes.size(), 0);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            const bvh_node& node = nodes[i];
+            if (node.count < 0 || depth[i] >= max_stack_depth)
+                return false;
+            if (node.count > 0) {
+                if (node.first < 0 || size_t(node.first) + size_t(node.count) > primitive_count)
+                    return false;
+                continue;
+            }
+            if (node.axis < 0 || node.axis > 2 || i + 1 >= nodes.size() || node.first <= int(i) + 1
+                || size_t(node.first) >= nodes.size())
+                return false;
+            depth[i + 1] = depth[node.first] = depth[i] + 1;
+        }
+        return true;
+    }
+
+    // walks the tree front to back and calls hit_leaf(first, count, ray_t) for every leaf the
+    // ray reaches. hit_leaf returns true on a hit and shrinks ray_t.max to the hit distance,
+    // which lets the traversal skip anything further away.
+    template <typename LeafFn>
+    bool traverse(const ray& r, interval ray_t, LeafFn&& hit_leaf) const {
+        if (nodes.empty())
+            return false;
+
+        const point3& orig = r.origin();
+        const vec3& dir = r.direction();
+        const vec3 inv_dir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+        const bool dir_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+        struct entry { int node; real t_enter; };
+        entry stack[max_stack_depth];
+        int stack_size = 0;
+
+        // tallied here and handed over once, at the end
+        uint64_t node_tests = 1, primitive_tests = 0;
+
+        real t_root;
+        if (!nodes[0].bbox.hit(orig, inv_dir, ray_t, t_root)) {
+            ray_counters::count_tests(node_tests, 0);
+            return false;
+        }
+
+        bool hit_anything = false;
+        int current = 0;
+
+        while (true) {
+            const bvh_node& node = nodes[current];
+
+            if (node.count > 0) {
+                primitive_tests += node.count;
+                if (hit_leaf(node.first, node.count, ray_t))
+                    hit_anything = true;
+            } else {
+                node_tests += 2;
+                int near_child = current + 1;
+                int far_child  = node.first;
+                if (dir_neg[node.axis])
+                    std::swap(near_child, far_child);
+
+                real t_near, t_far;
+                bool hit_near = nodes[near_child].bbox.hit(orig, inv_dir, ray_t, t_near);
+                bool hit_far  = nodes[far_child].bbox.hit(orig, inv_dir, ray_t, t_far);
+
+                if (hit_near && hit_far) {
+                    if (t_far < t_near) {
+                        std::swap(near_child, far_child);
+                        std::swap(t_near, t_far);
+                    }
+                    stack[stack_size++] = { far_child, t_far };
+                    current = near_child;
+                    continue;
+                }
+                if (hit_near) { current = near_child; continue; }
+                if (hit_far)  { current = far_child;  continue; }
+            }
+
+            // pop the next node, skipping any that are now behind the closest hit
+            bool found = false;
+            while (stack_size > 0) {
+                const entry& e = stack[--stack_size];
+                if (e.t_enter <= ray_t.max) {
+                    current = e.node;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                break;
+        }
+
+        ray_counters::count_tests(node_tests, primitive_tests);
+        return hit_anything;
+    }
+
+  private:
+    static constexpr int bin_count = 16;
+    // past this depth splits fall back to the object median, which bounds the tree depth
+    // (and so the traversal stack) even for badly clustered input
+    static constexpr int sah_depth_limit = 48;
+    static constexpr int max_stack_depth = 96;
+
+    double prim_cost = 1.0;
+
+    struct bin {
+        aabb bbox;
+        int  count = 0;
+    };
+
+    int build_node(const std::vector<aabb>& boxes, const std::vector<point3>& centroids,
+                   std::vector<int>& order, int begin, int end, int depth, int max_leaf_size) {
+        int node_index = int(nodes.size());
+        nodes.push_back({});
+
+        aabb bbox, centroid_bounds;
+        for (int i = begin; i < end; i++) {
+            bbox = aabb(bbox, boxes[order[i]]);
+            centroid_bounds = aabb(centroid_bounds, aabb(centroids[order[i]], centroids[order[i]]));
+        }
+
+        int count = end - begin;
+        int axis = centroid_bounds.longest_axis();
+        int mid = begin;
+
+        if (count <= 1 || !find_split(boxes, centroids, order, begin, end, bbox, centroid_bounds,
+                                      depth, max_leaf_size, axis, mid)) {
+            nodes[node_index] = { bbox, begin, count, 0 };
+            return node_index;
+        }
+
+        build_node(boxes, centroids, order, begin, mid, depth + 1, max_leaf_size);
+        int right = build_node(boxes, centroids, order, mid, end, depth + 1, max_leaf_size);
+        nodes[node_index] = { bbox, right, 0, axis };
+        return node_index;
+    }
+
+    // partitions order[begin, end) and sets axis/mid to the chosen split.
+    // returns false if keeping the range as a single leaf is cheaper.
+    bool find_split(const std::vector<aabb>& boxes, const std::vector<point3>& centroids,
+                    std::vector<int>& order, int begin, int end, const aabb& bbox,
+                    const aabb& centroid_bounds, int depth, int max_leaf_size, int& axis, int& mid) {
+        int count = end - begin;
+        const interval& extent = centroid_bounds.axis_interval(axis);
+
+        if (extent.size() <= 0) {
+            // every centroid coincides, no plane can separate them
+            if (count <= max_leaf_size)
+                return false;
+            mid = begin + count / 2;
+            return true;
+        }
+
+        if (depth >= sah_depth_limit) {
+            mid = begin + count / 2;
+            std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+            return true;
+        }
+
+        // bin centroids along every axis and sweep for the cheapest plane
+        double best_cost = infinity;
+        int best_axis = -1, best_bin = -1;
+
+        for (int a = 0; a < 3; a++) {
+            const interval& ext = centroid_bounds.axis_interval(a);
+            if (ext.size() <= 0)
+                continue;
+
+            bin bins[bin_count];
+            double scale = bin_count / ext.size();
+            for (int i = begin; i < end; i++) {
+                int b = bin_index(centroids[order[i]][a], ext.min, scale);
+                bins[b].count++;
+                bins[b].bbox = aabb(bins[b].bbox, boxes[order[i]]);
+            }
+
+            // right-to-left sweep stores the area/count of everything right of each plane
+            double right_area[bin_count - 1];
+            int right_count[bin_count - 1];
+            aabb right_box;
+            int right_sum = 0;
+            for (int b = bin_count - 1; b > 0; b--) {
+                right_box = aabb(right_box, bins[b].bbox);
+                right_sum += bins[b].count;
+                right_area[b - 1] = right_box.surface_area();
+                right_count[b - 1] = right_sum;
+            }
+
+            aabb left_box;
+            int left_sum = 0;
+            for (int b = 0; b < bin_count - 1; b++) {
+                left_box = aabb(left_box, bins[b].bbox);
+                left_sum += bins[b].count;
+                if (left_sum == 0 || right_count[b] == 0)
+                    continue;
+                double cost = left_sum * left_box.surface_area() + right_count[b] * right_area[b];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_bin = b;
+                }
+            }
+        }
+
+        double leaf_cost = count * prim_cost;
+        double split_cost = 1.0 + prim_cost * best_cost / bbox.surface_area();
+
+        if (best_axis < 0 || (count <= max_leaf_size && leaf_cost <= split_cost)) {
+            if (count <= max_leaf_size)
+                return false;
+            mid = begin + count / 2;
+            return true;
+        }
+
+        axis = best_axis;
+        const interval& ext = centroid_bounds.axis_interval(axis);
+        double scale = bin_count / ext.size();
+        auto split = std::partition(order.begin() + begin, order.begin() + end, [&](int i) {
+            return bin_index(centroids[i][axis], ext.min, scale) <= best_bin;
+        });
+        mid = int(split - order.begin());
+        return true;
+    }
+
+    static int bin_index(double c, double min, double scale) {
+        int b = int((c - min) * scale);
+        return b < 0 ? 0 : (b >= bin_count ? bin_count - 1 : b);
+    }
+};
+
+/*
+Bounding volume hierarchy over a hittable_list.
+Drop-in replacement for the list itself: hit tests cost roughly log(n) instead of n.
+*/
+class bvh : public hittable {
+  public:
+    explicit bvh(hittable_list list, int max_leaf_size = 4) : list(std::move(list)) {
+        auto& objects = this->list.objects;
+        std::vector<aabb> boxes;
+        boxes.reserve(objects.size());
+        for (const auto& object : objects)
+            boxes.push_back(object->bounding_box());
+
+        auto order = tree.build(boxes, max_leaf_size);
+
+        // reorder objects so every leaf is a contiguous range
+        std::vector<const hittable*> sorted(objects.size());
+        for (size_t i = 0; i < order.size(); i++)
+            sorted[i] = objects[order[i]];
+        objects = std::move(sorted);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        const auto& objects = list.objects;
+        return tree.traverse(r, ray_t, [&](int first, int count, interval& t) {
+            bool hit_anything = false;
+            for (int i = first; i < first + count; i++) {
+                if (objects[i]->intersect(r, t, rec)) {
+                    hit_anything = true;
+                    t.max = rec.t;
+                }
+            }
+            return hit_anything;
+        });
+    }
+
+    aabb bounding_box() const override { return tree.bounding_box(); }
+
+    size_t node_count() const { return tree.nodes.size(); }
+
+  private:
+    hittable_list list; // owns the objects, which the constructor leaves in leaf order
+    bvh_tree tree;
+};
+
+#endif
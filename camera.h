@@ -3,11 +3,30 @@
 
 #include "hittable.h"
 #include "material.h"
-
+#include "framebuffer.h"
+#include "accumulator.h"
+#include "aov.h"
+#include "lights.h"
+#include "sampler.h"
+#include "wavefront.h"
+#include "stats.h"
+#include "instrument.h"
+#include "progress.h"
+#include "thread_pool.h"
+
+#include <algorithm>
 #include <thread>
-#include <mutex>
 #include <chrono>
 #include <atomic>
+#include <limits>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// how a camera sample's path is traced, see ray_colour, trace_path and wavefront.h.
+// wavefront traces whole tiles at once, so adaptive sampling uses iterative instead.
+enum class integrator_type { recursive, iterative, wavefront };
 
 /*
 This class represents a camera in the scene. 
@@ -21,6 +40,12 @@ class camera {
     int    samples_per_pixel = 10;  // number of samples per pixel
     int    max_depth = 10; // max recursion depth
 
+    integrator_type integrator = integrator_type::iterative; // recursive kept for A/B checks
+    int    roulette_depth = 3; // bounces before russian roulette can end a path (not recursive)
+    bool   log_progress = true; // print progress and thread stats to clog, as progress_style says
+    progress_format progress_style = progress_format::text; // how log_progress prints progress
+    bool   time_bounces = false; // time every bounce for stats(), at a clock read or two each
+
     double vfov = 90; // vertical field of view in degrees
     point3 lookfrom = point3(0,0,0);   // point that camera is looking from
     point3 lookat   = point3(0,0,-1);  // point that camera is looking at
@@ -29,80 +54,230 @@ class camera {
     double defocus_angle = 0;   // variation angle of rays thru each pixek
     double focus_distance = 10; //distance from camera lookfrom pt to perfect focus
 
-    void render(const hittable& world) {
+    // shutter interval, in the time moving objects are keyed in (see moving_sphere). each
+    // ray is sent at a random time in it, so motion blurs in a single render. open == close
+    // means an instant, and rays don't spend a random number on their time.
+    double shutter_open = 0;
+    double shutter_close = 0;
+
+    // lights sampled directly at every diffuse bounce, with mis against the bounce itself (see
+    // lights.h). without them light is only found by paths bouncing into emitters or the sky.
+    const light_list* lights = nullptr;
+    bool   sky_light = true; // the sky gradient as background; off leaves it black, for interiors
+
+    int    thread_count = 0; // render threads, 0 means one per hardware thread
+    thread_pool* pool = nullptr; // threads to render on instead of starting new ones, see thread_pool.h
+    int    tile_size = 16;   // width and height of the screen-space tiles handed to threads
+    int    frame_index = 0;  // frame number, part of the random seed for every sample
+    sampler_type sampling = sampler_type::independent; // how samples spread their numbers, see sampler.h
+
+    // adaptive sampling: each pixel stops once its estimated error is below the threshold,
+    // taking at least min_samples and at most samples_per_pixel
+    bool   adaptive = false;
+    int    min_samples = 16;
+    double adaptive_threshold = 0.005; // std error of the mean in display (gamma) units
+
+    // when set, render also fills it with the first-hit albedo, normal and depth of every
+    // pixel, for the denoiser (see render_aovs and denoise.h)
+    aov_buffers* aovs = nullptr;
+    int    aov_samples = 16; // most camera rays a pixel's aovs average, they settle far quicker than colour
+
+    // renders the world into a linear float framebuffer, see image_writer.h to save it
+    template <typename World>
+    framebuffer render(const World& world) {
+        RT_COUNT(render);
+        RT_SCOPE("render");
+        if (aovs)
+            *aovs = render_aovs(world);
         initialize();
-        auto start_time = std::chrono::high_resolution_clock::now();
 
-        std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-        
-        // buffer for threading output
-        std::vector<std::string> image_rows(image_height);
-
-        // find number of threads/cores 
-        int thread_count = std::thread::hardware_concurrency();
-        if (thread_count == 0) thread_count = 4;
-        std::clog << "Using " << thread_count << " threads\n";
-        std::vector<std::thread> threads;
-        std::mutex mtx;
+        // buffer for threading output, one colour per pixel
+        framebuffer pixels(image_width, image_height);
+        samples_taken.assign(size_t(image_width) * image_height, 0);
+        render_into(world, pixels, 0, 0, image_width, image_height);
+
+        if (adaptive && log_progress) {
+            double average = average_samples_taken();
+            if (progress_style == progress_format::json)
+                write_event(std::clog, "adaptive", "average_samples", average, "samples_per_pixel", samples_per_pixel);
+            else
+                std::clog << "Adaptive sampling: " << average << " samples per pixel on average ("
+                          << int(100 * average / samples_per_pixel) << "% of " << samples_per_pixel << " spp)\n\n";
+        }
 
-        int rows_per_thread = image_height / thread_count;
+        return pixels;
+    }
 
-        //rending lamba func given a start and end row
-        auto scanlines_remaining = std::make_shared<std::atomic<int>>(image_height);
+    // the aovs of every pixel (see aov.h), from the first aov_samples of the camera rays its
+    // colour samples start with. only those rays are traced, to the first surface that isn't
+    // a mirror or glass, so this costs a fraction of a render. for renders that don't go through render, such as
+    // progressive and distributed ones; render fills camera::aovs itself.
+    template <typename World>
+    aov_buffers render_aovs(const World& world) {
+        RT_SCOPE("render_aovs");
+        initialize();
 
-        // lambda function to be 'worked on' by each thread
-        auto render_rows = [&](int start_row, int end_row) {
-            for (int j = start_row; j < end_row; ++j) {
-                std::ostringstream row_output;
-                for (int i = 0; i < image_width; ++i) {
-                    colour pixel_colour(0, 0, 0);
-                    for (int s = 0; s < samples_per_pixel; ++s) {
-                        ray r = get_ray(i, j);
-                        pixel_colour += ray_colour(r, max_depth, world);
-                    }
-                    write_colour(row_output, pixel_samples_scale * pixel_colour);
+        aov_buffers buffers(image_width, image_height);
+        int count = std::max(1, std::min(samples_per_pixel, aov_samples));
+        bool logging = std::exchange(log_progress, false);
+        for_each_pixel([&](int i, int j) {
+            colour albedo(0, 0, 0), normal(0, 0, 0), emission(0, 0, 0);
+            double depth = 0;
+            int hits = 0;
+            for (int s = 0; s < count; s++) {
+                sampler samples(sampling, frame_index, i, j, image_width, s, samples_per_pixel);
+                ray r = get_ray(i, j, samples);
+                colour throughput(1, 1, 1);
+                double distance = 0;
+                hit_record rec;
+                bool hit = world.hit(r, interval(0.001, infinity), rec);
+                // through mirrors and glass to what they show, which is where the edges are
+                ray next;
+                for (int bounce = 0; hit && bounce < 4 && follow_specular(*rec.material_ptr, r, rec, next, throughput); bounce++) {
+                    distance += rec.t * r.direction().length();
+                    r = next;
+                    hit = world.hit(r, interval(0.001, infinity), rec);
+                }
+                if (hit) {
+                    if (rec.material_ptr->kind == material_kind::emissive)
+                        emission += throughput * static_cast<const diffuse_light&>(*rec.material_ptr).emitted(rec);
+                    albedo += throughput * surface_albedo(*rec.material_ptr, rec);
+                    normal += rec.normal;
+                    depth += distance + rec.t * r.direction().length();
+                    hits++;
+                } else {
+                    albedo += throughput * background(r);
                 }
-
-                // update buffer
-                image_rows[j] = row_output.str();
-                
-                // mutex on scanlines_remaining to log
-                std::lock_guard<std::mutex> lock(mtx);
-                std::clog << "\rScanlines remaining: " << --(*scanlines_remaining) << ' ' << std::flush;
-            }
-        };
-        
-        int curr_row = 0;
-        for (int i = 0; i < thread_count; i++) {
-            int start_row = curr_row;
-            int end_row = curr_row + rows_per_thread;
-            if (i == thread_count - 1) {
-                end_row = image_height;
             }
-            threads.push_back(std::thread(render_rows, start_row, end_row));
-            curr_row = end_row;
-        }
+            buffers.albedo.set(i, j, albedo / real(count));
+            buffers.normal.set(i, j, normal / real(count));
+            buffers.emission.set(i, j, emission / real(count));
+            buffers.set_depth(i, j, hits > 0 ? float(depth / hits) : std::numeric_limits<float>::infinity());
+        });
+        log_progress = logging;
+        return buffers;
+    }
+
+    // pixels x0 <= i < x1, y0 <= j < y1 of the image render would make, with exactly the
+    // same values, in a framebuffer of just that region. for splitting one render between
+    // processes, see distributed.h.
+    template <typename World>
+    framebuffer render_region(const World& world, int x0, int y0, int x1, int y1) {
+        RT_COUNT(render);
+        RT_SCOPE("render_region");
+        initialize();
+
+        framebuffer pixels(x1 - x0, y1 - y0);
+        samples_taken.assign(size_t(image_width) * image_height, 0);
+        render_into(world, pixels, x0, y0, x1, y1);
+        return pixels;
+    }
+
+    // one pass of a progressive render: adds the next pass_samples samples of every pixel to
+    // the accumulator, which must be image sized. samples are seeded by their index, so a
+    // render split into passes (or resumed from a checkpoint) sees the same samples as one
+    // done in a single go, as long as samples_per_pixel stays the same for the stratified
+    // sampler (see fingerprint).
+    template <typename World>
+    void render_pass(const World& world, accumulator& accum, int pass_samples) {
+        RT_COUNT(render);
+        RT_SCOPE("render_pass");
+        initialize();
 
-        // join threads togethr
-        for (auto& t : threads) {
-            t.join();
+        int first = accum.samples();
+        if (integrator == integrator_type::wavefront) {
+            for_each_tile([&](int x0, int y0, int x1, int y1) {
+                const auto& sums = wavefront_tile(x0, y0, x1, y1, first, pass_samples, world);
+                for (int j = y0; j < y1; ++j)
+                    for (int i = x0; i < x1; ++i)
+                        accum.add(i, j, sums[size_t(j - y0) * (x1 - x0) + (i - x0)]);
+            });
+            accum.add_samples(pass_samples);
+            return;
         }
 
-        // dumping buffer held in mem to cout
-        std::clog << "\nWriting image to cout...\n";
-        for (int j = 0; j < image_height; ++j) {
-            std::cout << image_rows[j];
+        for_each_pixel([&](int i, int j) {
+            colour sum(0, 0, 0);
+            for (int s = first; s < first + pass_samples; ++s)
+                sum += trace_sample(i, j, s, world);
+            accum.add(i, j, sum);
+        });
+        accum.add_samples(pass_samples);
+    }
+
+    // rays, intersection tests, bounce times and thread use of the last render or pass
+    const render_stats& stats() const { return last_stats; }
+
+    // image height in pixels, from image_width and aspect_ratio
+    int rendered_height() const {
+        int height = int(image_width / aspect_ratio);
+        return (height < 1) ? 1 : height;
+    }
+
+    // fnv-1a over everything that decides what a pixel's samples are and what they see, but
+    // not how many there are: the view, integrator, sampler and frame, and the scene as far as
+    // its bounds, its lights and scene (a name for it, such as its file) tell it apart. a
+    // checkpoint has to match it to be carried on, and a worker (see distributed.h) to join.
+    // the stratified sampler is the exception: its strata are cut for samples_per_pixel, so
+    // more samples would stratify every sample differently, and the count is in it too.
+    uint64_t fingerprint(const aabb& scene_bounds, const std::string& scene = "") const {
+        uint64_t h = 1469598103934665603ull;
+        auto mix_bytes = [&](const void* data, size_t size) {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            for (size_t k = 0; k < size; k++)
+                h = (h ^ p[k]) * 1099511628211ull;
+        };
+        auto mix = [&](const auto& value) { mix_bytes(&value, sizeof(value)); };
+        mix(image_width); mix(rendered_height()); mix(max_depth);
+        mix(integrator); mix(roulette_depth); mix(frame_index); mix(sampling);
+        mix(vfov); mix(lookfrom); mix(lookat); mix(vup);
+        mix(defocus_angle); mix(focus_distance); mix(shutter_open); mix(shutter_close);
+        mix(sky_light); mix(lights ? lights->size() : 0);
+        if (sampling == sampler_type::stratified)
+            mix(samples_per_pixel);
+        for (int a = 0; a < 3; a++) {
+            mix(scene_bounds.axis_interval(a).min);
+            mix(scene_bounds.axis_interval(a).max);
         }
+        mix_bytes(scene.data(), scene.size());
+        return h;
+    }
 
-        auto end_time = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> elapsed_time = end_time - start_time;
-        std::clog << "\nDone.";
-        std::clog << "\nElapsed render time: " << elapsed_time.count() << " seconds\n";
-        std::clog << "\n";
+    double average_samples_taken() const {
+        double total = 0;
+        for (int n : samples_taken)
+            total += n;
+        return samples_taken.empty() ? 0 : total / samples_taken.size();
+    }
 
+    // samples each pixel of the last render took, as an image: blue for min_samples (or
+    // fewer) through green and yellow to red for samples_per_pixel
+    framebuffer sample_heatmap() const {
+        framebuffer heatmap(image_width, image_height);
+        int lo = adaptive ? std::min(min_samples, samples_per_pixel) : 0;
+        double range = std::max(1, samples_per_pixel - lo);
+        for (int j = 0; j < image_height; j++) {
+            for (int i = 0; i < image_width; i++) {
+                double t = (samples_taken[size_t(j) * image_width + i] - lo) / range;
+                t = interval(0, 1).clamp(t);
+                colour c = t < 0.5 ? (1 - 2*t) * colour(0, 0, 1) + 2*t * colour(0, 1, 0)
+                                   : (2 - 2*t) * colour(1, 1, 0) + (2*t - 1) * colour(1, 0, 0);
+                heatmap.set(i, j, c * c); // squared, so it shows these colours after gamma
+            }
+        }
+        return heatmap;
     }
 
   private:
+    struct alignas(64) thread_stats { // own cache line each, threads update these per tile
+        render_stats::thread use;
+        ray_counters counters; // the thread's ray_counters::local(), copied when it's done
+    };
+
+    // paths traced together by the wavefront integrator. big enough for the stages to run
+    // long loops, small enough that a batch's queue stays in cache.
+    static constexpr size_t wavefront_batch = 1024;
+
     int    image_height;   // rendered image height
     double pixel_samples_scale; // colour scale factor for a sum of pizel samples
     point3 center;         // cam center
@@ -111,10 +286,11 @@ class camera {
     vec3   pixel_delta_v;  // offset to pixel below
     vec3   u, v, w;        // camera basis vectors
     vec3   defocus_disk_u, defocus_disk_v; // defocus disk basis vectors (horiz and vert)
+    std::vector<int> samples_taken; // per pixel sample count of the last render
+    render_stats last_stats;
 
     void initialize() {
-        image_height = int(image_width / aspect_ratio);
-        image_height = (image_height < 1) ? 1 : image_height;
+        image_height = rendered_height();
 
         pixel_samples_scale = 1.0 / samples_per_pixel;
 
@@ -149,46 +325,380 @@ class camera {
         defocus_disk_v = defocus_radius * v;
     }
 
-    ray get_ray(int i, int j) const {
+    // renders the region x_begin <= i < x_end, y_begin <= j < y_end of the image into pixels,
+    // whose pixel 0,0 is x_begin,y_begin
+    template <typename World>
+    void render_into(const World& world, framebuffer& pixels, int x_begin, int y_begin, int x_end, int y_end) {
+        if (integrator == integrator_type::wavefront && !adaptive) {
+            for_each_tile([&](int x0, int y0, int x1, int y1) {
+                const auto& sums = wavefront_tile(x0, y0, x1, y1, 0, samples_per_pixel, world);
+                for (int j = y0; j < y1; ++j) {
+                    for (int i = x0; i < x1; ++i) {
+                        pixels.set(i - x_begin, j - y_begin, pixel_samples_scale * sums[size_t(j - y0) * (x1 - x0) + (i - x0)]);
+                        samples_taken[size_t(j) * image_width + i] = samples_per_pixel;
+                    }
+                }
+            }, x_begin, y_begin, x_end, y_end);
+            return;
+        }
+
+        for_each_pixel([&](int i, int j) {
+            int taken;
+            pixels.set(i - x_begin, j - y_begin, sample_pixel(i, j, world, taken));
+            samples_taken[size_t(j) * image_width + i] = taken;
+        }, x_begin, y_begin, x_end, y_end);
+    }
+
+    // runs fn(i, j) for every pixel, see for_each_tile
+    template <typename PixelFn>
+    void for_each_pixel(PixelFn&& fn, int x_begin = 0, int y_begin = 0, int x_end = -1, int y_end = -1) {
+        for_each_tile([&](int x0, int y0, int x1, int y1) {
+            for (int j = y0; j < y1; ++j)
+                for (int i = x0; i < x1; ++i)
+                    fn(i, j);
+        }, x_begin, y_begin, x_end, y_end);
+    }
+
+    // runs fn(x0, y0, x1, y1) for every tile, i.e. pixels x0 <= i < x1, y0 <= j < y1, of the
+    // image or of the region given (an end of -1 being the image's edge). the region is cut
+    // into small tiles which threads pull off a shared counter as they finish, so threads
+    // that land on cheap sky tiles just take more of them.
+    template <typename TileFn>
+    void for_each_tile(TileFn&& fn, int x_begin = 0, int y_begin = 0, int x_end = -1, int y_end = -1) {
+        if (x_end < 0) x_end = image_width;
+        if (y_end < 0) y_end = image_height;
+        auto start_time = std::chrono::high_resolution_clock::now();
+
+        // find number of threads/cores
+        int threads_to_use = pool ? pool->size() : thread_count > 0 ? thread_count : default_thread_count();
+        if (log_progress && progress_style == progress_format::json)
+            write_event(std::clog, "threads", "count", threads_to_use);
+        else if (log_progress)
+            std::clog << "Using " << threads_to_use << " threads\n";
+
+        int tiles_x = (x_end - x_begin + tile_size - 1) / tile_size;
+        int tiles_y = (y_end - y_begin + tile_size - 1) / tile_size;
+        int tile_count = tiles_x * tiles_y;
+        std::atomic<int> next_tile(0);
+
+        std::vector<std::thread> threads;
+        std::vector<thread_stats> stats(threads_to_use);
+        std::optional<progress_reporter> progress;
+        if (log_progress)
+            progress.emplace(tile_count, progress_style, std::clog);
+
+        // lambda function to be 'worked on' by each thread
+        auto render_tiles = [&](int thread_index) {
+            thread_stats& stat = stats[thread_index];
+            ray_counters::local() = ray_counters();
+            while (true) {
+                int tile = next_tile.fetch_add(1, std::memory_order_relaxed);
+                if (tile >= tile_count)
+                    break;
+
+                auto tile_start = std::chrono::high_resolution_clock::now();
+                uint64_t rays_before = progress ? ray_counters::local().rays() : 0;
+
+                int x0 = x_begin + (tile % tiles_x) * tile_size;
+                int y0 = y_begin + (tile / tiles_x) * tile_size;
+                int x1 = std::min(x0 + tile_size, x_end);
+                int y1 = std::min(y0 + tile_size, y_end);
+
+                {
+                    RT_COUNT(tile);
+                    RT_SCOPE("tile");
+                    fn(x0, y0, x1, y1);
+                }
+
+                stat.use.busy_seconds += seconds_between(tile_start, std::chrono::high_resolution_clock::now());
+                stat.use.tiles++;
+
+                if (progress)
+                    progress->tile_done(ray_counters::local().rays() - rays_before);
+            }
+            stat.counters = ray_counters::local();
+        };
+
+        if (pool) {
+            pool->run(render_tiles);
+        } else {
+            for (int i = 0; i < threads_to_use; i++) {
+                threads.push_back(std::thread(render_tiles, i));
+            }
+
+            // join threads togethr
+            for (auto& t : threads) {
+                t.join();
+            }
+        }
+        if (progress)
+            progress->stop();
+
+        double render_seconds = seconds_between(start_time, std::chrono::high_resolution_clock::now());
+        last_stats = render_stats();
+        last_stats.render_seconds = render_seconds;
+        // the wavefront integrator always times its bounces
+        last_stats.bounces_timed = time_bounces || (integrator == integrator_type::wavefront && !adaptive);
+        for (const auto& stat : stats) {
+            last_stats.threads.push_back(stat.use);
+            last_stats.add(stat.counters);
+        }
+
+        if (!log_progress)
+            return;
+
+        // every thread was available for the whole render, so whatever it didn't spend on
+        // tiles was spent idle waiting for the others to finish
+        if (progress_style == progress_format::json) {
+            for (int i = 0; i < threads_to_use; i++) {
+                const auto& use = last_stats.threads[i];
+                write_event(std::clog, "thread", "thread", i, "tiles", use.tiles, "busy_seconds", use.busy_seconds,
+                            "idle_seconds", std::max(0.0, render_seconds - use.busy_seconds));
+            }
+            write_event(std::clog, "render_done", "seconds", render_seconds);
+            return;
+        }
+        std::clog << "\nThread utilisation (" << tile_count << " tiles of " << tile_size << "px):\n";
+        for (int i = 0; i < threads_to_use; i++) {
+            const auto& use = last_stats.threads[i];
+            double idle = std::max(0.0, render_seconds - use.busy_seconds);
+            std::clog << "  thread " << i << ": " << use.tiles << " tiles, busy "
+                      << use.busy_seconds << "s, idle " << idle << "s ("
+                      << int(100 * use.busy_seconds / render_seconds) << "% busy)\n";
+        }
+
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed_time = end_time - start_time;
+        std::clog << "\nDone.";
+        std::clog << "\nElapsed render time: " << elapsed_time.count() << " seconds\n";
+        std::clog << "\n";
+    }
+
+    // traces camera sample s of pixel i,j
+    template <typename World>
+    colour trace_sample(int i, int j, int s, const World& world) const {
+        // seeded per sample so the image doesn't depend on thread scheduling
+        sampler samples(sampling, frame_index, i, j, image_width, s, samples_per_pixel);
+        ray r = get_ray(i, j, samples);
+        if (integrator == integrator_type::recursive)
+            return ray_colour(r, max_depth, world, samples);
+        return trace_path(r, world, samples);
+    }
+
+    // sums of samples first .. first+count-1 for every pixel of a tile, row major, traced
+    // together as one wavefront batch. the samples are the ones trace_sample would take and
+    // are summed in the same order, so the result matches it exactly. the returned buffer is
+    // reused by the thread's next call.
+    template <typename World>
+    const std::vector<colour>& wavefront_tile(int x0, int y0, int x1, int y1, int first, int count,
+                                              const World& world) const {
+        thread_local path_queue queue;
+        thread_local wavefront_integrator tracer;
+        thread_local std::vector<colour> results, sums;
+
+        tracer.max_depth = max_depth;
+        tracer.roulette_depth = roulette_depth;
+        tracer.lights = lights && !lights->empty() ? lights : nullptr;
+        auto sky = [this](const ray& r) { return background(r); };
+
+        size_t pixel_count = size_t(x1 - x0) * (y1 - y0);
+        results.assign(pixel_count * count, colour(0, 0, 0));
+        for (int j = y0; j < y1; ++j) {
+            for (int i = x0; i < x1; ++i) {
+                int p = (j - y0) * (x1 - x0) + (i - x0);
+                for (int s = 0; s < count; ++s) {
+                    sampler samples(sampling, frame_index, i, j, image_width, first + s, samples_per_pixel);
+                    ray r = get_ray(i, j, samples);
+                    RT_COUNT(ray_colour);
+                    queue.push(r, p * count + s, samples);
+                    if (queue.size() == wavefront_batch)
+                        tracer.trace(queue, world, sky, results.data());
+                }
+            }
+        }
+        tracer.trace(queue, world, sky, results.data());
+
+        sums.assign(pixel_count, colour(0, 0, 0));
+        for (size_t p = 0; p < pixel_count; p++)
+            for (int s = 0; s < count; ++s)
+                sums[p] += results[p * count + s];
+        return sums;
+    }
+
+    // averages camera samples for pixel i,j. with adaptive sampling on, a running mean and
+    // variance of the pixel's luminance (welford's method) is checked every few samples and
+    // sampling stops once the standard error of the mean, converted to display units, is
+    // below adaptive_threshold.
+    template <typename World>
+    colour sample_pixel(int i, int j, const World& world, int& taken) const {
+        colour pixel_colour(0, 0, 0);
+
+        double mean = 0, m2 = 0;
+        const int check_every = 4;
+
+        int s = 0;
+        while (s < samples_per_pixel) {
+            colour sample = trace_sample(i, j, s, world);
+            pixel_colour += sample;
+            s++;
+
+            if (!adaptive)
+                continue;
+
+            double lum = luminance(sample);
+            double delta = lum - mean;
+            mean += delta / s;
+            m2 += delta * (lum - mean);
+
+            if (s >= min_samples && s % check_every == 0) {
+                double std_error = std::sqrt(m2 / (s - 1) / s);
+                // gamma is a sqrt, whose slope at the mean scales the error on screen
+                double display_error = std_error / (2 * std::sqrt(std::fmax(mean, 1e-4)));
+                if (display_error < adaptive_threshold)
+                    break;
+            }
+        }
+
+        taken = s;
+        return (s == samples_per_pixel ? pixel_samples_scale : 1.0 / s) * pixel_colour;
+    }
+
+    static double seconds_between(std::chrono::high_resolution_clock::time_point a,
+                                  std::chrono::high_resolution_clock::time_point b) {
+        return std::chrono::duration<double>(b - a).count();
+    }
+
+    ray get_ray(int i, int j, sampler& samples) const {
         // construct a camera ray originating from the defocus disk and directed at a randomly
         // sampled point around the pixel location i,j
-        auto offset = sample_square();
+        auto offset = sample_square(samples);
         auto pixel_sample = pixel00_loc
                     + ((i + offset.x()) * pixel_delta_u)
                     + ((j + offset.y()) * pixel_delta_v);
 
-        auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+        auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample(samples);
         auto ray_direction = pixel_sample - ray_origin;
-        return ray(ray_origin, ray_direction);
+        auto ray_time = (shutter_close > shutter_open)
+                      ? shutter_open + samples.get_1d() * (shutter_close - shutter_open) : shutter_open;
+        return ray(ray_origin, ray_direction, ray_time);
     }
 
-    vec3 sample_square() const {
-        return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+    vec3 sample_square(sampler& samples) const {
+        sample_2d s = samples.get_2d();
+        return vec3(s.u - 0.5, s.v - 0.5, 0);
     }
     
-    point3 defocus_disk_sample() const {
-        auto p = random_in_unit_disk();
+    point3 defocus_disk_sample(sampler& samples) const {
+        sample_2d s = samples.get_2d();
+        auto p = disk_from_square(s.u, s.v);
         return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
-    colour ray_colour(const ray& r, int depth, const hittable& world) const {
+    template <typename World>
+    colour ray_colour(const ray& r, int depth, const World& world, sampler& samples) const {
         if (depth <= 0) {
             // max recursion depth exceeded
             return colour(0, 0, 0);
         }
 
+        RT_COUNT(ray_colour);
+        ray_counters::local().count_ray(max_depth - depth);
         hit_record rec;
         
         // ignoring hits that are very close to zero i.e. removes shadow acne
         // https://digitalrune.github.io/DigitalRune-Documentation/html/3f4d959e-9c98-4a97-8d85-7a73c26145d7.htm
         if (world.hit(r, interval(0.001, infinity), rec)) {
+            if (rec.material_ptr->kind == material_kind::emissive)
+                return static_cast<const diffuse_light&>(*rec.material_ptr).emitted(rec);
             ray scattered;
             colour attenuation;
-            if (rec.material_ptr->scatter(r, rec, attenuation, scattered))
-                return attenuation * ray_colour(scattered, depth-1, world);
+            if (scatter<World>(r, rec, attenuation, scattered, samples))
+                return attenuation * ray_colour(scattered, depth-1, world, samples);
             return colour(0,0,0);
         }
 
+        return background(r);
+    }
+
+    // same estimate as ray_colour but as a loop: the product of attenuations so far is kept
+    // as a running throughput instead of being built up on the way back out of the recursion.
+    // once a path has bounced a few times, russian roulette stops it with a probability based
+    // on how little it can still contribute, and scales up the survivors to stay unbiased.
+    // with lights to sample, each diffuse bounce also adds light sampled from them directly,
+    // and light found by the bounce after it is weighted to match (see lights.h).
+    template <typename World>
+    colour trace_path(ray r, const World& world, sampler& samples) const {
+        RT_COUNT(ray_colour);
+        colour throughput(1, 1, 1);
+        colour radiance(0, 0, 0);
+        ray_counters& counters = ray_counters::local();
+        const light_list* sampled = lights && !lights->empty() ? lights : nullptr;
+        real brdf_pdf = 0; // density the last bounce picked r with; 0 for mirrors, glass and the camera
+
+        for (int depth = 0; depth < max_depth; depth++) {
+            counters.count_ray(depth);
+            scoped_seconds timer(time_bounces ? counters.seconds_slot(depth) : nullptr);
+
+            hit_record rec;
+            // ignoring hits that are very close to zero i.e. removes shadow acne
+            if (!world.hit(r, interval(0.001, infinity), rec))
+                return radiance + throughput * background(r);
+
+            material_kind kind = rec.material_ptr->kind;
+            if (kind == material_kind::emissive) {
+                colour emit = static_cast<const diffuse_light&>(*rec.material_ptr).emitted(rec);
+                real weight = sampled && brdf_pdf > 0 ? sampled->brdf_weight(r, rec, emit, brdf_pdf) : 1;
+                return radiance + weight * (throughput * emit);
+            }
+
+            if (sampled && kind == material_kind::lambertian) {
+                const colour& albedo = static_cast<const lambertian&>(*rec.material_ptr).albedo;
+                ray shadow;
+                real distance;
+                colour direct;
+                if (sampled->sample_direct(rec, albedo, r.time(), samples, shadow, distance, direct)) {
+                    RT_COUNT(shadow_ray);
+                    hit_record blocker; // only whether there is one matters, so no surface
+                    if (!world.intersect(shadow, interval(0.001, distance), blocker))
+                        radiance += throughput * direct;
+                }
+            }
+
+            ray scattered;
+            colour attenuation;
+            if (!scatter<World>(r, rec, attenuation, scattered, samples))
+                return radiance;
+
+            if (sampled)
+                brdf_pdf = kind == material_kind::lambertian ? lambertian::pdf(rec, scattered) : 0;
+            throughput = throughput * attenuation;
+            r = scattered;
+
+            if (depth + 1 >= roulette_depth) {
+                real survive = std::fmin(real(0.95), std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())));
+                if (samples.get_1d() >= survive)
+                    return radiance;
+                throughput /= survive;
+            }
+        }
+
+        // max depth exceeded
+        return radiance;
+    }
+
+    // closed-set worlds (see closed_world.h) scatter through a switch that can be inlined,
+    // anything else through the vtable
+    template <typename World>
+    static bool scatter(const ray& r_in, const hit_record& rec, colour& attenuation, ray& scattered, sampler& samples) {
+        if constexpr (World::closed_set)
+            return scatter_closed(*rec.material_ptr, r_in, rec, attenuation, scattered, samples);
+        else
+            return rec.material_ptr->scatter(r_in, rec, attenuation, scattered, samples);
+    }
+
+    colour background(const ray& r) const {
+        if (!sky_light)
+            return colour(0, 0, 0);
         vec3 unit_direction = unit_vector(r.direction());
         auto a = 0.5*(unit_direction.y() + 1.0);
         return (1.0-a)*colour(1.0, 1.0, 1.0) + a*colour(0.5, 0.7, 1.0);
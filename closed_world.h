@@ -0,0 +1,130 @@
+#ifndef CLOSED_WORLD_H
+#define CLOSED_WORLD_H
+
+#include "bvh.h"
+#include "lights.h"
+#include "material.h"
+#include "quad.h"
+#include "sphere.h"
+
+#include <deque>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+// the closed set of primitives, held by value
+using primitive_variant = std::variant<sphere, moving_sphere, quad>;
+
+/*
+A world built only from the closed sets of primitives and materials, all stored by value:
+primitives in one array in bvh leaf order, materials in another. Hit tests pick the
+primitive's hit with std::visit, and since this class is final a camera rendering it as a
+closed_world (rather than through a hittable&) calls hit directly and scatters with
+scatter_closed, so the whole bounce can be inlined.
+
+Spheres and quads with an emissive material also go in the world's light list, for the
+camera to sample (camera::lights). Lights don't move: a moving sphere can't be emissive.
+*/
+class closed_world final : public hittable {
+  public:
+    static constexpr bool closed_set = true;
+
+    closed_world() = default;
+    // primitives point at the materials, so the world stays where it was built
+    closed_world(const closed_world&) = delete;
+    closed_world& operator=(const closed_world&) = delete;
+
+    // returns the shared material with these parameters, making it if it's new
+    const material* add_material(const material_desc& m) {
+        auto found = material_index.find(m);
+        if (found != material_index.end())
+            return found->second;
+        materials.push_back(m.make_variant());
+        const material* ptr = std::visit([](const auto& alt) -> const material* { return &alt; }, materials.back());
+        material_index.emplace(m, ptr);
+        return ptr;
+    }
+
+    void add(const point3& center, double radius, const material_desc& m) {
+        primitives.emplace_back(sphere(center, radius, add_material(m)));
+        if (m.type == material_kind::emissive)
+            light_sources.add_sphere(center, radius, m.albedo);
+    }
+
+    // a sphere at center0 at time 0 and center1 at time 1, see moving_sphere
+    void add_moving(const point3& center0, const point3& center1, double radius, const material_desc& m) {
+        primitives.emplace_back(moving_sphere(center0, center1, radius, add_material(m)));
+    }
+
+    // a parallelogram, see quad
+    void add_quad(const point3& q, const vec3& u, const vec3& v, const material_desc& m) {
+        primitives.emplace_back(quad(q, u, v, add_material(m)));
+        if (m.type == material_kind::emissive)
+            light_sources.add_quad(q, u, v, m.albedo);
+    }
+
+    size_t size() const { return primitives.size(); }
+
+    const light_list& lights() const { return light_sources; }
+
+    // builds the bvh and the light list's table; call once every primitive is in
+    void build(int max_leaf_size = 4) {
+        light_sources.build();
+
+        std::vector<aabb> boxes;
+        boxes.reserve(primitives.size());
+        for (const auto& p : primitives)
+            boxes.push_back(std::visit([](const auto& prim) { return prim.bounding_box(); }, p));
+
+        auto order = tree.build(boxes, max_leaf_size);
+
+        std::vector<primitive_variant> sorted;
+        sorted.reserve(primitives.size());
+        for (int i : order)
+            sorted.push_back(std::move(primitives[i]));
+        primitives = std::move(sorted);
+    }
+
+    // the primitives are held by value, so the world records which one was hit and works
+    // out its surface itself
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        return tree.traverse(r, ray_t, [&](int first, int count, interval& t) {
+            bool hit_anything = false;
+            for (int i = first; i < first + count; i++) {
+                bool hit = std::visit([&](const auto& prim) { return prim.intersect(r, t, rec); }, primitives[i]);
+                if (hit) {
+                    hit_anything = true;
+                    t.max = rec.t;
+                    rec.primitive = i;
+                }
+            }
+            if (hit_anything)
+                rec.object = this;
+            return hit_anything;
+        });
+    }
+
+    void surface(const ray& r, hit_record& rec) const override {
+        std::visit([&](const auto& prim) { prim.surface(r, rec); }, primitives[rec.primitive]);
+    }
+
+    // hittable::hit, but calling this class's own intersect and surface, which (being final)
+    // can be inlined into a camera rendering the world as itself
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const {
+        if (!intersect(r, ray_t, rec))
+            return false;
+        surface(r, rec);
+        return true;
+    }
+
+    aabb bounding_box() const override { return tree.bounding_box(); }
+
+  private:
+    std::vector<primitive_variant> primitives;
+    std::deque<material_variant> materials; // a deque so growing it doesn't move them
+    std::unordered_map<material_desc, const material*, material_desc_hash> material_index;
+    bvh_tree tree;
+    light_list light_sources;
+};
+
+#endif
@@ -13,25 +13,9 @@ inline double linear_to_gamma(double x) {
     return 0;
 }
 
-void write_colour(std::ostream& out, const colour& pixel_colour) {
-    auto r = pixel_colour.x();
-    auto g = pixel_colour.y();
-    auto b = pixel_colour.z();
-
-
-    // apply gamma transform
-    r = linear_to_gamma(r);
-    g = linear_to_gamma(g);
-    b = linear_to_gamma(b);
-
-
-    // Translate the [0,1] component values to the byte range [0,255]
-    static const interval intensity(0.000, 0.999);
-    int rbyte = int(256 * intensity.clamp(r));
-    int gbyte = int(256 * intensity.clamp(g));
-    int bbyte = int(256 * intensity.clamp(b));
-    
-    out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
+// brightness as the eye sees it, from linear rgb (rec. 709 weights)
+inline double luminance(const colour& c) {
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,232 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "aov.h"
+#include "framebuffer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+Edge avoiding a-trous wavelet filter (dammertz et al., "edge-avoiding a-trous wavelet
+transform for fast global illumination filtering", 2010), guided by the aovs.
+
+Light seen straight off an emitter is taken out first and put back at the end: it isn't
+noisy, and it's far brighter than anything round it, so any of it spread would show. What's
+left is divided by the albedo, so what gets blurred is the light reaching each surface and
+texture comes back sharp when it's multiplied back in, and fireflies are clamped. Then a few
+passes of a 5x5 b-spline kernel, the i'th with its taps 2^i pixels apart, which together
+cover a wide area for 25 taps a pass. Each tap is weighed down by how far it is from the centre pixel in
+normal, depth and brightness, so it blurs along surfaces and stops at their edges. How far
+in brightness is measured against the noise, estimated from how much the pixels round the
+centre vary, so the filter blurs less the more samples the render took. The estimate is
+filtered too, as a variance (with the weights squared), so each pass allows for the noise
+the ones before it left (schied et al., "spatiotemporal variance-guided filtering", 2017).
+
+The image is held as separate float planes with a border round it that's never taken from,
+so a row's loop over one tap reads memory in order with no edge checks and vectorises, and
+threads take rows off a shared counter.
+*/
+class denoiser {
+  public:
+    int   iterations = 5;        // passes; the last one's taps are 2^(iterations-1) pixels apart
+    float colour_sigma = 4.0f;   // brightness difference that counts as an edge, in multiples of the noise
+    float normal_sigma = 0.3f;   // distance between unit normals that does
+    float depth_sigma = 0.01f;   // depth difference per pixel of tap spacing, relative to depth
+    int   thread_count = 0;      // threads, 0 means one per hardware thread
+    thread_pool* pool = nullptr; // threads to use instead of starting new ones
+
+    framebuffer denoise(const framebuffer& image, const aov_buffers& aovs) {
+        const int width = image.width(), height = image.height();
+        const int border = 2 << (iterations - 1); // the last pass's outermost taps
+        stride = width + 2 * border;
+        const size_t n = size_t(stride) * (height + 2 * border);
+        auto at = [&](int i, int j) { return size_t(j + border) * stride + i + border; };
+
+        for (auto* plane : { &in[0], &in[1], &in[2], &in[3], &out[0], &out[1], &out[2], &out[3],
+                             &bright, &key, &noise, &nx, &ny, &nz, &z, &valid })
+            plane->assign(n, 0.0f);
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                size_t p = at(i, j);
+                colour c = image.get(i, j) - aovs.emission.get(i, j);
+                colour a = aovs.albedo.get(i, j), normal = aovs.normal.get(i, j);
+                for (int k = 0; k < 3; k++)
+                    in[k][p] = std::max(0.0f, float(c[k])) / std::max(float(a[k]), min_albedo);
+                nx[p] = float(normal.x());
+                ny[p] = float(normal.y());
+                nz[p] = float(normal.z());
+                // misses far enough away to differ from any hit, but finite so two of them match
+                z[p] = std::isfinite(aovs.depth(i, j)) ? aovs.depth(i, j) : 1e30f;
+                valid[p] = 1;
+            }
+        }
+
+        // a pixel brighter than all eight round it is most likely a single unlucky sample (a
+        // firefly), which the filter would take for detail and keep, or spread: it's brought
+        // down to the brightest of them
+        for (size_t p = 0; p < n; p++)
+            bright[p] = 0.2126f * in[0][p] + 0.7152f * in[1][p] + 0.0722f * in[2][p];
+        for_each_row(height, [&](int j) {
+            for (size_t p = at(0, j), end = p + width; p < end; p++) {
+                float brightest = 0;
+                for (int dy = -1; dy <= 1; dy++)
+                    for (int dx = -1; dx <= 1; dx++)
+                        if (dx != 0 || dy != 0)
+                            brightest = std::max(brightest, bright[p + ptrdiff_t(dy) * stride + dx]);
+                float scale = bright[p] > brightest ? brightest / bright[p] : 1.0f;
+                for (int k = 0; k < 3; k++)
+                    out[k][p] = in[k][p] * scale;
+            }
+        });
+        std::swap(in, out);
+
+        for (int pass = 0; pass < iterations; pass++) {
+            // brightness to compare, blurred over 3x3 first: a stray bright or dark sample
+            // would otherwise look like an edge to every pixel around it, and be kept
+            for (size_t p = 0; p < n; p++)
+                bright[p] = valid[p] * std::sqrt(std::max(0.0f, 0.2126f * in[0][p] + 0.7152f * in[1][p] + 0.0722f * in[2][p]));
+            // the first pass also takes how much brightness varies over those 3x3 as the noise
+            // there, which sets how different a tap can be and still count as the same surface.
+            // after that the estimate is filtered along with the colour
+            for_each_row(height, [&](int j) {
+                for (size_t p = at(0, j), end = p + width; p < end; p++) {
+                    float sum = 0, sum_squares = 0, count = 0;
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            size_t q = p + ptrdiff_t(dy) * stride + dx;
+                            sum += bright[q];
+                            sum_squares += bright[q] * bright[q];
+                            count += valid[q];
+                        }
+                    }
+                    key[p] = sum / count;
+                    if (pass == 0)
+                        in[3][p] = std::max(0.0f, sum_squares / count - key[p] * key[p]);
+                    noise[p] = 1 / (colour_sigma * colour_sigma * in[3][p] + min_variance);
+                }
+            });
+
+            int step = 1 << pass;
+            tap_scales scales{ 1 / (normal_sigma * normal_sigma), 1 / (depth_sigma * step) };
+            for_each_row(height, [&](int j) {
+                filter_row(at(0, j), width, step, scales);
+            });
+            std::swap(in, out);
+        }
+
+        framebuffer result(width, height);
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                size_t p = at(i, j);
+                colour a = aovs.albedo.get(i, j);
+                colour c = aovs.emission.get(i, j);
+                for (int k = 0; k < 3; k++)
+                    c[k] += in[k][p] * std::max(float(a[k]), min_albedo);
+                result.set(i, j, c);
+            }
+        }
+        return result;
+    }
+
+  private:
+    static constexpr float min_albedo = 1e-3f;   // black surfaces are divided by this instead
+    static constexpr float min_variance = 1e-5f; // noise below this (in display units squared) counts as this
+
+    // planes of stride floats a row, border included: the image being filtered (divided by
+    // albedo) with the variance of its noise, and the pass's output; sqrt luminance and its
+    // blur to compare, and what a squared difference in that is scaled by; normal, depth, and
+    // 1 for a pixel of the image or 0 for the border. kept between calls so frames reuse them.
+    int stride = 0;
+    std::vector<float> in[4], out[4], bright, key, noise, nx, ny, nz, z, valid;
+
+    struct tap_scales {
+        float normal, depth; // what the squared (depth: relative) differences are scaled by
+    };
+
+    // e^-x for x >= 0, near enough for a weight: (1 - x/256)^256. unlike std::exp the compiler
+    // can keep it in simd registers, as long as the clamp at 0 isn't a comparison it can't
+    // if-convert
+    static float exp_negative(float x) {
+        float y = 1.0f - x * (1.0f / 256);
+        y = (y + std::fabs(y)) * 0.5f;
+        y *= y; y *= y; y *= y; y *= y;
+        y *= y; y *= y; y *= y; y *= y;
+        return y;
+    }
+
+    // one pass over the row of width pixels starting at plane index first, chunk pixels at a
+    // time. the sums are kept on the stack, where the compiler can see nothing else points,
+    // so the loop over a tap vectorises without checking each plane against them
+    void filter_row(size_t first, int width, int step, const tap_scales& scales) {
+        static constexpr float spline[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+        static constexpr int chunk = 64;
+        const float *r = in[0].data(), *g = in[1].data(), *b = in[2].data(), *variance = in[3].data();
+        const float *k = key.data(), *scale = noise.data(), *x_normal = nx.data(), *y_normal = ny.data(), *z_normal = nz.data();
+        const float *depth = z.data(), *inside = valid.data();
+
+        for (int x0 = 0; x0 < width; x0 += chunk) {
+            const int count = std::min(chunk, width - x0);
+            const size_t start = first + x0;
+            float sum_r[chunk] = {}, sum_g[chunk] = {}, sum_b[chunk] = {}, sum_v[chunk] = {}, sum_w[chunk] = {};
+
+            for (int dy = -2; dy <= 2; dy++) {
+                for (int dx = -2; dx <= 2; dx++) {
+                    const float h = spline[dx + 2] * spline[dy + 2];
+                    const ptrdiff_t offset = ptrdiff_t(dy * stride + dx) * step;
+                    for (int x = 0; x < count; x++) {
+                        size_t p = start + x, q = p + offset;
+                        float dk = k[p] - k[q];
+                        float dx_normal = x_normal[p] - x_normal[q];
+                        float dy_normal = y_normal[p] - y_normal[q];
+                        float dz_normal = z_normal[p] - z_normal[q];
+                        float dn = dx_normal * dx_normal + dy_normal * dy_normal + dz_normal * dz_normal;
+                        float dz = std::fabs(depth[p] - depth[q]) / depth[p];
+                        float w = h * inside[q] * exp_negative(dk * dk * scale[p] + dn * scales.normal + dz * scales.depth);
+                        sum_r[x] += w * r[q];
+                        sum_g[x] += w * g[q];
+                        sum_b[x] += w * b[q];
+                        sum_v[x] += w * w * variance[q];
+                        sum_w[x] += w;
+                    }
+                }
+            }
+
+            // the centre tap always counts, so the weights never sum to 0
+            for (int x = 0; x < count; x++) {
+                float inverse = 1 / sum_w[x];
+                out[0][start + x] = sum_r[x] * inverse;
+                out[1][start + x] = sum_g[x] * inverse;
+                out[2][start + x] = sum_b[x] * inverse;
+                out[3][start + x] = sum_v[x] * inverse * inverse;
+            }
+        }
+    }
+
+    // runs fn(j) for every row j < rows, on the pool or on threads started for it
+    template <typename RowFn>
+    void for_each_row(int rows, RowFn&& fn) const {
+        std::atomic<int> next_row(0);
+        auto work = [&](int) {
+            for (int j; (j = next_row.fetch_add(1, std::memory_order_relaxed)) < rows;)
+                fn(j);
+        };
+        if (pool) {
+            pool->run(work);
+            return;
+        }
+        int threads_to_use = thread_count > 0 ? thread_count : default_thread_count();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < threads_to_use; i++)
+            threads.emplace_back(work, i);
+        for (auto& t : threads)
+            t.join();
+    }
+};
+
+#endif
@@ -0,0 +1,438 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "camera.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+One render split between processes. The coordinator cuts the image into square work units,
+hands them to worker processes over tcp and copies the pixels they send back into the image.
+Workers build the same scene from the same command line and render a unit with
+camera::render_region; every sample is seeded by its pixel and index, so a unit comes out
+the same whichever process renders it, and the assembled image is identical to a single
+process render.
+
+A worker that disconnects, or goes quiet for longer than the timeout while it holds units,
+is dropped and its units go back in the queue. Once the queue is empty, idle workers are
+given copies of units still out elsewhere, so one slow or stuck worker can't hold up the
+end of the render; whichever copy comes back first is used. If every spawned worker has
+gone, the coordinator renders what's left itself.
+
+The protocol is a type and a payload size (uint32 each) and then the payload, in the native
+layout: workers are assumed to be built from the same source for the same architecture,
+which the hello message's fingerprint of the render settings partly checks.
+*/
+
+namespace distributed_detail {
+
+enum message_type : uint32_t { hello = 1, unit = 2, result = 3, done = 4 };
+
+struct message_header {
+    uint32_t type;
+    uint32_t size;
+};
+
+struct hello_message {
+    uint64_t fingerprint; // of the render settings and scene bounds, see fingerprint()
+    int32_t  threads;
+    int32_t  pad;
+};
+
+struct unit_message {
+    int32_t id, x0, y0, x1, y1;
+};
+
+// followed by the unit's pixels, (x1-x0)*(y1-y0)*3 floats
+struct result_header {
+    int32_t  id;
+    int32_t  pad;
+    uint64_t rays;
+};
+
+inline bool write_all(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+inline bool read_all(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = ::recv(fd, p, size, 0);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+inline bool send_message(int fd, uint32_t type, const void* payload, size_t size,
+                         const void* extra = nullptr, size_t extra_size = 0) {
+    message_header h{ type, uint32_t(size + extra_size) };
+    return write_all(fd, &h, sizeof(h)) && write_all(fd, payload, size)
+        && (extra_size == 0 || write_all(fd, extra, extra_size));
+}
+
+inline bool receive_message(int fd, uint32_t& type, std::vector<char>& payload) {
+    message_header h;
+    if (!read_all(fd, &h, sizeof(h)) || h.size > (1u << 30))
+        return false;
+    type = h.type;
+    payload.resize(h.size);
+    return read_all(fd, payload.data(), h.size);
+}
+
+// the camera's fingerprint with the sample counts added, so a worker started with different
+// settings or a different scene is turned away instead of mixing its tiles in
+inline uint64_t fingerprint(const camera& cam, const aabb& scene_bounds) {
+    uint64_t h = cam.fingerprint(scene_bounds);
+    auto mix = [&](const auto& value) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t k = 0; k < sizeof(value); k++)
+            h = (h ^ p[k]) * 1099511628211ull;
+    };
+    mix(cam.samples_per_pixel); mix(cam.adaptive); mix(cam.min_samples); mix(cam.adaptive_threshold);
+    return h;
+}
+
+} // namespace distributed_detail
+
+struct coordinator_options {
+    int port = 0;          // to listen on, 0 for any free one
+    int spawn = 0;         // local worker processes to start
+    std::vector<std::string> worker_command; // program and arguments spawned workers run, to
+                                             // which "--worker 127.0.0.1:port" is added
+    int unit_size = 64;    // width and height of a work unit in pixels
+    int units_per_worker = 2; // units a worker holds at once, so it never waits on the network
+    int timeout_seconds = 120; // a worker holding units that's silent for this long is dropped
+};
+
+// renders as a worker for the coordinator at address ("ipv4:port") until it's told it's done
+// or the coordinator goes away. returns false if it couldn't connect.
+template <typename World>
+bool run_worker(camera& cam, const World& world, const std::string& address, std::string& error) {
+    using namespace distributed_detail;
+
+    size_t colon = address.rfind(':');
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    if (colon == std::string::npos || ::inet_pton(AF_INET, address.substr(0, colon).c_str(), &addr.sin_addr) != 1) {
+        error = "bad coordinator address " + address + ", expected ipv4:port";
+        return false;
+    }
+    addr.sin_port = htons(uint16_t(std::atoi(address.c_str() + colon + 1)));
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        error = "can't connect to " + address;
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    thread_pool threads(cam.thread_count > 0 ? cam.thread_count : default_thread_count());
+    cam.pool = &threads;
+    cam.log_progress = false;
+
+    hello_message hi{ fingerprint(cam, world.bounding_box()), threads.size(), 0 };
+    bool ok = send_message(fd, hello, &hi, sizeof(hi));
+
+    // the coordinator closing the connection is as good as done: it may have finished
+    // with a copy of the unit this worker was still rendering
+    uint32_t type;
+    std::vector<char> payload;
+    while (ok && receive_message(fd, type, payload)) {
+        if (type != unit || payload.size() != sizeof(unit_message))
+            break;
+        unit_message u;
+        std::memcpy(&u, payload.data(), sizeof(u));
+        framebuffer pixels = cam.render_region(world, u.x0, u.y0, u.x1, u.y1);
+
+        result_header r{ u.id, 0, cam.stats().total_rays() };
+        ok = send_message(fd, result, &r, sizeof(r), pixels.data(), sizeof(float) * 3 * size_t(pixels.width()) * pixels.height());
+    }
+    ::close(fd);
+    cam.pool = nullptr;
+    return true;
+}
+
+// renders the image the camera would, split between worker processes as described above
+template <typename World>
+bool render_distributed(camera& cam, const World& world, const coordinator_options& options,
+                        framebuffer& image, std::string& error) {
+    using namespace distributed_detail;
+    using clock = std::chrono::steady_clock;
+
+    int width = cam.image_width, height = cam.rendered_height();
+    uint64_t expected = fingerprint(cam, world.bounding_box());
+
+    std::vector<unit_message> units;
+    for (int y = 0; y < height; y += options.unit_size)
+        for (int x = 0; x < width; x += options.unit_size)
+            units.push_back({ int32_t(units.size()), x, y, std::min(x + options.unit_size, width), std::min(y + options.unit_size, height) });
+
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(uint16_t(options.port));
+    socklen_t addr_size = sizeof(addr);
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+        || ::listen(listener, 64) != 0 || ::getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &addr_size) != 0) {
+        error = "can't listen on port " + std::to_string(options.port);
+        if (listener >= 0)
+            ::close(listener);
+        return false;
+    }
+    int port = ntohs(addr.sin_port);
+    if (cam.progress_style == progress_format::json)
+        write_event(std::clog, "coordinator", "port", port, "units", units.size(), "unit_size", options.unit_size);
+    else
+        std::clog << "Coordinator on port " << port << ", " << units.size() << " units of " << options.unit_size << "px\n";
+
+    std::vector<pid_t> children;
+    for (int k = 0; k < options.spawn; k++) {
+        std::vector<std::string> args = options.worker_command;
+        args.push_back("--worker");
+        args.push_back("127.0.0.1:" + std::to_string(port));
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            ::close(listener);
+            std::vector<char*> argv;
+            for (auto& a : args)
+                argv.push_back(a.data());
+            argv.push_back(nullptr);
+            ::execv(argv[0], argv.data());
+            ::_exit(127);
+        }
+        if (pid > 0)
+            children.push_back(pid);
+    }
+
+    struct worker {
+        explicit worker(int fd) : fd(fd) {}
+
+        int fd;
+        bool ready = false; // said hello with the right fingerprint
+        std::vector<int> units; // units it's rendering, oldest first
+        clock::time_point last_heard = clock::now();
+    };
+    std::vector<worker> workers;
+    std::deque<int> queue;
+    for (const auto& u : units)
+        queue.push_back(u.id);
+    std::vector<uint8_t> finished(units.size(), 0);
+    size_t finished_count = 0;
+
+    image = framebuffer(width, height);
+    std::optional<progress_reporter> progress;
+    if (cam.log_progress)
+        progress.emplace(int(units.size()), cam.progress_style, std::clog);
+
+    auto drop = [&](size_t w, const char* why) {
+        for (int id : workers[w].units)
+            if (!finished[id])
+                queue.push_front(id);
+        if (cam.log_progress && workers[w].ready && cam.progress_style == progress_format::json)
+            write_event(std::clog, "worker_dropped", "reason", why, "units_reissued", workers[w].units.size());
+        else if (cam.log_progress && workers[w].ready)
+            std::clog << "\nWorker dropped (" << why << "), " << workers[w].units.size() << " units reissued\n";
+        ::close(workers[w].fd);
+        workers.erase(workers.begin() + w);
+    };
+    auto children_alive = [&] {
+        for (pid_t& pid : children)
+            if (pid > 0 && ::waitpid(pid, nullptr, WNOHANG) == pid)
+                pid = 0;
+        for (pid_t pid : children)
+            if (pid > 0)
+                return true;
+        return false;
+    };
+
+    std::vector<char> payload;
+    while (finished_count < units.size()) {
+        // with no workers left to wait for, finish the render here
+        if (workers.empty() && options.spawn > 0 && !children_alive()) {
+            if (cam.log_progress && cam.progress_style == progress_format::json)
+                write_event(std::clog, "no_workers");
+            else if (cam.log_progress)
+                std::clog << "\nNo workers left, rendering the remaining units here\n";
+            bool log = cam.log_progress;
+            cam.log_progress = false;
+            for (const auto& u : units) {
+                if (finished[u.id])
+                    continue;
+                framebuffer pixels = cam.render_region(world, u.x0, u.y0, u.x1, u.y1);
+                for (int j = u.y0; j < u.y1; j++)
+                    for (int i = u.x0; i < u.x1; i++)
+                        image.set(i, j, pixels.get(i - u.x0, j - u.y0));
+                finished[u.id] = 1;
+                finished_count++;
+                if (progress)
+                    progress->tile_done(cam.stats().total_rays());
+            }
+            cam.log_progress = log;
+            break;
+        }
+
+        std::vector<pollfd> fds{ { listener, POLLIN, 0 } };
+        for (const auto& w : workers)
+            fds.push_back({ w.fd, POLLIN, 0 });
+        ::poll(fds.data(), fds.size(), 500);
+
+        if (fds[0].revents & POLLIN) {
+            int fd = ::accept(listener, nullptr, nullptr);
+            if (fd >= 0) {
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                timeval timeout{ options.timeout_seconds, 0 };
+                ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                workers.emplace_back(fd);
+            }
+        }
+
+        // back to front, so dropping a worker doesn't move the ones still to be looked at
+        for (size_t w = fds.size() - 1; w >= 1; w--) {
+            size_t k = w - 1;
+            if (k >= workers.size())
+                continue;
+            if (!(fds[w].revents & (POLLIN | POLLHUP | POLLERR))) {
+                if (!workers[k].units.empty() && clock::now() - workers[k].last_heard > std::chrono::seconds(options.timeout_seconds))
+                    drop(k, "timed out");
+                continue;
+            }
+
+            uint32_t type;
+            if (!receive_message(workers[k].fd, type, payload)) {
+                drop(k, "disconnected");
+                continue;
+            }
+            workers[k].last_heard = clock::now();
+
+            if (type == hello && payload.size() == sizeof(hello_message)) {
+                hello_message hi;
+                std::memcpy(&hi, payload.data(), sizeof(hi));
+                if (hi.fingerprint != expected) {
+                    if (cam.progress_style == progress_format::json)
+                        write_event(std::cerr, "worker_turned_away", "reason", "different render settings or scene");
+                    else
+                        std::cerr << "\nTurned away a worker with different render settings or scene\n";
+                    send_message(workers[k].fd, done, nullptr, 0);
+                    drop(k, "wrong settings");
+                    continue;
+                }
+                workers[k].ready = true;
+                if (cam.log_progress && cam.progress_style == progress_format::json)
+                    write_event(std::clog, "worker_joined", "threads", hi.threads);
+                else if (cam.log_progress)
+                    std::clog << "\nWorker joined with " << hi.threads << " threads\n";
+                continue;
+            }
+
+            result_header r;
+            if (type != result || payload.size() < sizeof(r)) {
+                drop(k, "bad message");
+                continue;
+            }
+            std::memcpy(&r, payload.data(), sizeof(r));
+            auto& held = workers[k].units;
+            auto it = std::find(held.begin(), held.end(), r.id);
+            if (it == held.end()) {
+                drop(k, "unasked for result");
+                continue;
+            }
+            held.erase(it);
+
+            const unit_message& u = units[r.id];
+            size_t floats = size_t(3) * (u.x1 - u.x0) * (u.y1 - u.y0);
+            if (payload.size() != sizeof(r) + floats * sizeof(float)) {
+                drop(k, "bad result");
+                continue;
+            }
+            if (finished[r.id])
+                continue; // another worker's copy got here first
+
+            const float* pixels = reinterpret_cast<const float*>(payload.data() + sizeof(r));
+            for (int j = u.y0; j < u.y1; j++)
+                std::memcpy(image.data() + 3 * (size_t(j) * width + u.x0),
+                            pixels + 3 * size_t(j - u.y0) * (u.x1 - u.x0), sizeof(float) * 3 * (u.x1 - u.x0));
+            finished[r.id] = 1;
+            finished_count++;
+            if (progress)
+                progress->tile_done(r.rays);
+        }
+
+        // hand out units: from the queue while there are any, then copies of units still out
+        for (size_t k = 0; k < workers.size(); k++) {
+            worker& w = workers[k];
+            while (w.ready && int(w.units.size()) < options.units_per_worker) {
+                while (!queue.empty() && finished[queue.front()])
+                    queue.pop_front();
+                int id = -1;
+                if (!queue.empty()) {
+                    id = queue.front();
+                    queue.pop_front();
+                } else if (w.units.empty()) {
+                    for (const auto& other : workers)
+                        for (int held : other.units)
+                            if (id < 0 && !finished[held] && &other != &w)
+                                id = held;
+                }
+                if (id < 0)
+                    break;
+                if (w.units.empty())
+                    w.last_heard = clock::now();
+                if (!send_message(w.fd, unit, &units[id], sizeof(unit_message))) {
+                    queue.push_front(id);
+                    drop(k--, "disconnected");
+                    break;
+                }
+                w.units.push_back(id);
+            }
+        }
+    }
+
+    if (progress)
+        progress->stop();
+    for (const auto& w : workers) {
+        send_message(w.fd, done, nullptr, 0);
+        ::close(w.fd);
+    }
+    ::close(listener);
+    for (pid_t pid : children)
+        if (pid > 0)
+            ::waitpid(pid, nullptr, 0);
+    return true;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <cstdint>
+#include <vector>
+
+/*
+Image held as linear (not gamma corrected) float rgb, three floats per pixel, row by row
+from the top of the image. Render threads write straight into it; conversion to display
+bytes happens once at the end in to_bytes().
+*/
+class framebuffer {
+  public:
+    framebuffer() {}
+
+    framebuffer(int width, int height)
+        : image_width(width), image_height(height), pixels(size_t(3) * width * height, 0.0f) {}
+
+    int width() const { return image_width; }
+    int height() const { return image_height; }
+
+    void set(int i, int j, const colour& c) {
+        float* p = &pixels[3 * (size_t(j) * image_width + i)];
+        p[0] = float(c.x());
+        p[1] = float(c.y());
+        p[2] = float(c.z());
+    }
+
+    colour get(int i, int j) const {
+        const float* p = &pixels[3 * (size_t(j) * image_width + i)];
+        return colour(p[0], p[1], p[2]);
+    }
+
+    const float* data() const { return pixels.data(); }
+    float* data() { return pixels.data(); }
+
+    // gamma correct and quantise every channel to [0,255] in a single pass. it's one flat
+    // loop over floats with no branches the compiler can't turn into selects, so it vectorises.
+    std::vector<uint8_t> to_bytes() const {
+        std::vector<uint8_t> bytes(pixels.size());
+        const float* src = pixels.data();
+        uint8_t* dst = bytes.data();
+        for (size_t k = 0; k < pixels.size(); k++) {
+            float v = src[k] > 0.0f ? src[k] : 0.0f;
+            v = std::sqrt(v); // same gamma 2 transform as linear_to_gamma
+            v = v < 0.999f ? v : 0.999f;
+            dst[k] = uint8_t(256.0f * v);
+        }
+        return bytes;
+    }
+
+  private:
+    int image_width = 0;
+    int image_height = 0;
+    std::vector<float> pixels;
+};
+
+#endif
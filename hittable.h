@@ -1,28 +1,77 @@
 #ifndef HITTABLE
 #define HITTABLE
 
+#include "aabb.h"
+
 class material;
+class hittable;
 
+/*
+A ray's hit, in two parts. Traversal (hittable::intersect) only keeps the first: the
+distance and which primitive it was, overwritten each time something closer turns up.
+The rest, the surface at that point, is worked out once the closest hit is known
+(hittable::surface), so the sqrt and divisions that takes, and the stores, are spent on
+one hit a ray instead of on every hit that was closest for a while.
+*/
 struct hit_record {
     public:
+        // what intersect records
+        real t;
+        const hittable* object; // the object to ask for the surface
+        // what surface fills in
         point3 p;
         vec3 normal;
         const material* material_ptr;
-        double t;
+        // set by intersect too, for objects holding many primitives (which one was hit), but
+        // kept down here where it packs in beside front_face
+        int32_t primitive;
         bool front_face;
 
         inline void set_face_normal(const ray& r, const vec3& outward_normal) {
             front_face = dot(r.direction(), outward_normal) < 0;
             normal = front_face ? outward_normal : -outward_normal;
         }
+
+        // origin for a ray leaving the hit point in direction dir. float builds push it off
+        // the surface (see offset_ray_origin), since float rounding of p alone can exceed the
+        // 0.001 the integrators skip; doubles stay well inside that, so p is used as is.
+        point3 spawn_origin(const vec3& dir) const {
+            if constexpr (std::is_same_v<real, float>)
+                return offset_ray_origin(p, dot(dir, normal) > 0 ? normal : -normal);
+            else
+                return p;
+        }
 };
 
 class hittable {
     public:
+        // true for worlds whose materials are all in the closed set of material_kind, which
+        // lets the camera dispatch scatter with a switch instead of the vtable
+        static constexpr bool closed_set = false;
+
         virtual ~hittable() = default;
 
-        virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+        // the closest hit in ray_t: sets rec's t, object and primitive and nothing else,
+        // and leaves rec alone if there's no hit. enough for shadow rays, which only ask
+        // whether there is one.
+        virtual bool intersect(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+        // fills in the rest of rec for the hit intersect found on r. only called on
+        // rec.object, which is what set it; objects whose intersect fills in everything
+        // itself (see instance) leave this as it is
+        virtual void surface(const ray&, hit_record&) const {}
+
+        // the closest hit with its surface
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const {
+            if (!intersect(r, ray_t, rec))
+                return false;
+            rec.object->surface(r, rec);
+            return true;
+        }
+
+        // box enclosing the whole object, used to build the bvh
+        virtual aabb bounding_box() const = 0;
 };
 
 
-#endif
\ No newline at end of file
+#endif
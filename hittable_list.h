@@ -2,40 +2,94 @@
 #define HITTABLE_LIST_H
 
 #include "hittable.h"
+#include "instrument.h"
+#include "scene_arena.h"
+#include "stats.h"
 
+#include <memory>
 #include <vector>
 
+/*
+A list of hittables. Objects are either made in the list's arena with emplace(), which keeps
+them contiguous and is the way to build big scenes, or handed over already built with add().
+Either way the list owns them; objects holds plain pointers for the hit loop.
+*/
 class hittable_list : public hittable {
   public:
-    std::vector<std::unique_ptr<hittable>> objects;
+    std::vector<const hittable*> objects;
 
     hittable_list() = default;
     explicit hittable_list(std::unique_ptr<hittable> object) {
         add(std::move(object));
     }
 
-    void clear() { objects.clear(); }
+    void clear() {
+        objects.clear();
+        owned.clear();
+        arena = scene_arena();
+        bbox = aabb();
+    }
 
     void add(std::unique_ptr<hittable> object) {
-        objects.push_back(std::move(object));
+        append(object.get());
+        owned.push_back(std::move(object));
+    }
+
+    // owns an object without putting it in the list, e.g. geometry only seen through instances
+    const hittable* keep(std::unique_ptr<hittable> object) {
+        owned.push_back(std::move(object));
+        return owned.back().get();
     }
 
+    template <typename T, typename... Args>
+    T* emplace(Args&&... args) {
+        T* object = arena.make<T>(std::forward<Args>(args)...);
+        append(object);
+        return object;
+    }
 
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        hit_record temp_rec;
+    // shared material with these parameters, owned by the list
+    const material* make_material(const material_desc& m) {
+        return arena.make_material(m);
+    }
+
+    // takes ownership of a material that isn't shared with anything else
+    const material* add_material(std::unique_ptr<material> m) {
+        owned_materials.push_back(std::move(m));
+        return owned_materials.back().get();
+    }
+
+    size_t material_count() const { return arena.material_count() + owned_materials.size(); }
+
+    // objects only touch rec when they hit, and then only to record a closer hit, so they
+    // can all write straight into it
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
         bool hit_anything = false;
-        auto closest_so_far = ray_t.max;
+        ray_counters::count_tests(0, objects.size());
+        RT_COUNT(list_hit);
 
         for (const auto& object : objects) {
-            if (object->hit(r, {ray_t.min, closest_so_far}, temp_rec)) {
+            if (object->intersect(r, ray_t, rec)) {
                 hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
+                ray_t.max = rec.t;
             }
         }
 
         return hit_anything;
     }
+
+    aabb bounding_box() const override { return bbox; }
+
+  private:
+    std::vector<std::unique_ptr<hittable>> owned;
+    std::vector<std::unique_ptr<material>> owned_materials;
+    scene_arena arena;
+    aabb bbox;
+
+    void append(const hittable* object) {
+        bbox = aabb(bbox, object->bounding_box());
+        objects.push_back(object);
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
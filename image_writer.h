@@ -0,0 +1,168 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+Writers that turn a framebuffer into an image file.
+  ppm - binary P6, 8 bits per channel (default)
+  p3  - ascii P3, what the renderer used to print
+  pfm - portable float map, the raw linear floats for hdr tools
+  png - 8 bit rgb png, uncompressed so there's no zlib dependency
+*/
+enum class image_format { ppm, p3, pfm, png };
+
+inline bool parse_image_format(const std::string& name, image_format& format) {
+    if (name == "ppm") format = image_format::ppm;
+    else if (name == "p3") format = image_format::p3;
+    else if (name == "pfm") format = image_format::pfm;
+    else if (name == "png") format = image_format::png;
+    else return false;
+    return true;
+}
+
+inline void write_ppm(std::ostream& out, const framebuffer& fb) {
+    auto bytes = fb.to_bytes();
+    out << "P6\n" << fb.width() << ' ' << fb.height() << "\n255\n";
+    out.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+}
+
+inline void write_p3(std::ostream& out, const framebuffer& fb) {
+    auto bytes = fb.to_bytes();
+    out << "P3\n" << fb.width() << ' ' << fb.height() << "\n255\n";
+
+    // format into one big buffer instead of going through operator<< per channel
+    std::string text;
+    text.reserve(bytes.size() * 4);
+    char digits[4];
+    for (size_t k = 0; k < bytes.size(); k++) {
+        int len = std::snprintf(digits, sizeof(digits), "%d", bytes[k]);
+        text.append(digits, len);
+        text.push_back(k % 3 == 2 ? '\n' : ' ');
+    }
+    out.write(text.data(), std::streamsize(text.size()));
+}
+
+inline void write_pfm(std::ostream& out, const framebuffer& fb) {
+    // negative scale marks the data as little endian. rows go bottom to top.
+    out << "PF\n" << fb.width() << ' ' << fb.height() << "\n-1.0\n";
+    size_t row_floats = size_t(3) * fb.width();
+    for (int j = fb.height() - 1; j >= 0; j--) {
+        const float* row = fb.data() + size_t(j) * row_floats;
+        out.write(reinterpret_cast<const char*>(row), std::streamsize(row_floats * sizeof(float)));
+    }
+}
+
+namespace png_detail {
+
+inline uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline void put_u32(std::vector<uint8_t>& buf, uint32_t v) {
+    buf.push_back(uint8_t(v >> 24));
+    buf.push_back(uint8_t(v >> 16));
+    buf.push_back(uint8_t(v >> 8));
+    buf.push_back(uint8_t(v));
+}
+
+inline void write_chunk(std::ostream& out, const char* type, const std::vector<uint8_t>& payload) {
+    std::vector<uint8_t> chunk;
+    chunk.reserve(payload.size() + 12);
+    put_u32(chunk, uint32_t(payload.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), payload.begin(), payload.end());
+    put_u32(chunk, crc32(chunk.data() + 4, payload.size() + 4));
+    out.write(reinterpret_cast<const char*>(chunk.data()), std::streamsize(chunk.size()));
+}
+
+} // namespace png_detail
+
+inline void write_png(std::ostream& out, const framebuffer& fb) {
+    using namespace png_detail;
+
+    auto bytes = fb.to_bytes();
+    size_t row_bytes = size_t(3) * fb.width();
+
+    // raw scanlines, each prefixed with filter type 0 (none)
+    std::vector<uint8_t> raw;
+    raw.reserve((row_bytes + 1) * fb.height());
+    for (int j = 0; j < fb.height(); j++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), bytes.begin() + j * row_bytes, bytes.begin() + (j + 1) * row_bytes);
+    }
+
+    // zlib stream made of 'stored' deflate blocks (max 65535 bytes each), no compression
+    std::vector<uint8_t> z;
+    z.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    z.push_back(0x78);
+    z.push_back(0x01);
+    uint32_t a = 1, b = 0;
+    size_t pos = 0;
+    while (true) {
+        size_t len = std::min<size_t>(65535, raw.size() - pos);
+        bool last = pos + len == raw.size();
+        z.push_back(last ? 1 : 0);
+        z.push_back(uint8_t(len));
+        z.push_back(uint8_t(len >> 8));
+        z.push_back(uint8_t(~len));
+        z.push_back(uint8_t(~len >> 8));
+        for (size_t k = pos; k < pos + len; k++) {
+            a = (a + raw[k]) % 65521;
+            b = (b + a) % 65521;
+        }
+        z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + len);
+        pos += len;
+        if (last)
+            break;
+    }
+    put_u32(z, (b << 16) | a); // adler32 of the uncompressed data
+
+    std::vector<uint8_t> header;
+    put_u32(header, uint32_t(fb.width()));
+    put_u32(header, uint32_t(fb.height()));
+    header.push_back(8); // bit depth
+    header.push_back(2); // colour type rgb
+    header.push_back(0); // compression
+    header.push_back(0); // filter
+    header.push_back(0); // no interlace
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out.write(reinterpret_cast<const char*>(signature), 8);
+    write_chunk(out, "IHDR", header);
+    write_chunk(out, "IDAT", z);
+    write_chunk(out, "IEND", {});
+}
+
+inline void write_image(std::ostream& out, const framebuffer& fb, image_format format) {
+    switch (format) {
+        case image_format::ppm: write_ppm(out, fb); break;
+        case image_format::p3:  write_p3(out, fb);  break;
+        case image_format::pfm: write_pfm(out, fb); break;
+        case image_format::png: write_png(out, fb); break;
+    }
+}
+
+#endif
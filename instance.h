@@ -0,0 +1,52 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "hittable.h"
+#include "transform.h"
+
+/*
+A placed copy of shared geometry: any hittable (a mesh, a bvh of objects, another instance)
+seen through an affine transform, optionally with a material of its own. Only the transform
+into object space is stored. Rays are moved into object space without renormalising their
+direction, so t is the same in both spaces and the hit point is found on the world ray;
+the normal comes back out with the transpose of that transform.
+
+The geometry isn't owned and must outlive the instance. An instance is a pointer, a material
+and twelve numbers, whatever it shows.
+*/
+class instance final : public hittable {
+  public:
+    // material, if given, replaces the geometry's own
+    instance(const hittable* object, const affine& to_world, const material* material_ptr = nullptr)
+        : object(object), material_ptr(material_ptr), to_object(to_world.inverse()) {}
+
+    // the geometry's surface needs the ray in object space, which isn't kept, so it's worked
+    // out here for every hit rather than left for surface: the instance records itself as the
+    // object, with the hit already complete
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        ray local(to_object.point(r.origin()), to_object.vector(r.direction()), r.time());
+        if (!object->intersect(local, ray_t, rec))
+            return false;
+        rec.object->surface(local, rec);
+
+        // rec.normal already faces against the ray, and the transform keeps which side that is
+        rec.object = this;
+        rec.p = r.at(rec.t);
+        rec.normal = unit_vector(to_object.inverse_normal(rec.normal));
+        if (material_ptr)
+            rec.material_ptr = material_ptr;
+        return true;
+    }
+
+    // worked out on demand, like sphere's: only the bvh build asks
+    aabb bounding_box() const override {
+        return to_object.inverse().box(object->bounding_box());
+    }
+
+  private:
+    const hittable* object;
+    const material* material_ptr;
+    affine to_object;
+};
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+/*
+Profiling instrumentation, built in with RT_INSTRUMENT (cmake -DRT_INSTRUMENT=ON) and
+compiled out otherwise, so the macros can stay in the hot paths of production builds.
+
+    RT_COUNT(counter)   bumps one of the counters below for the current thread
+    RT_SCOPE("name")    records the enclosing scope as a span on the current thread
+
+Each thread writes only to its own buffer, so neither needs atomics or locks; a lock is
+taken once per thread, the first time it records anything. Buffers outlive their threads
+and are read by write_chrome_trace once the render's threads have been joined, giving a
+file chrome://tracing or https://ui.perfetto.dev can open.
+*/
+
+#include <cstdint>
+#include <string>
+
+namespace instrument {
+
+enum class counter {
+    render,             // camera::render and render_pass calls
+    tile,               // tiles rendered
+    ray_colour,         // ray_colour / trace_path calls, i.e. paths started
+    list_hit,           // hittable_list::intersect calls (hit is a wrapper around intersect)
+    sphere_hit,         // hit_sphere tests, from sphere and moving_sphere intersect
+    triangle_hit,       // ray-triangle tests in meshes
+    quad_hit,           // quad::intersect calls
+    shadow_ray,         // shadow rays traced for light sampling
+    scatter_lambertian, // scatter calls per material
+    scatter_metal,
+    scatter_dielectric,
+    count
+};
+
+inline const char* counter_name(counter c) {
+    static const char* names[] = { "render", "tile", "ray_colour", "list_hit", "sphere_hit", "triangle_hit",
+                                   "quad_hit", "shadow_ray", "scatter_lambertian", "scatter_metal", "scatter_dielectric" };
+    return names[int(c)];
+}
+
+} // namespace instrument
+
+#ifdef RT_INSTRUMENT
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace instrument {
+
+using clock = std::chrono::steady_clock;
+
+struct span {
+    const char* name;
+    int64_t start_ns; // since the process epoch, see epoch()
+    int64_t duration_ns;
+};
+
+struct thread_buffer {
+    int id;
+    uint64_t counters[int(counter::count)] = {};
+    std::vector<span> spans;
+};
+
+inline clock::time_point epoch() {
+    static const clock::time_point start = clock::now();
+    return start;
+}
+
+inline int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - epoch()).count();
+}
+
+// every thread's buffer, owned here so it outlives the thread
+class registry {
+  public:
+    static registry& get() {
+        static registry r;
+        return r;
+    }
+
+    thread_buffer* create() {
+        std::lock_guard<std::mutex> lock(mtx);
+        buffers.push_back(std::make_unique<thread_buffer>());
+        buffers.back()->id = int(buffers.size()) - 1;
+        return buffers.back().get();
+    }
+
+    // only safe while no instrumented threads are running
+    template <typename Fn>
+    void for_each(Fn&& fn) {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (const auto& b : buffers)
+            fn(*b);
+    }
+
+  private:
+    std::mutex mtx;
+    std::vector<std::unique_ptr<thread_buffer>> buffers;
+};
+
+inline thread_buffer& local() {
+    thread_local thread_buffer* buffer = registry::get().create();
+    return *buffer;
+}
+
+class scope {
+  public:
+    explicit scope(const char* name) : name(name), start(now_ns()) {}
+    ~scope() { local().spans.push_back({ name, start, now_ns() - start }); }
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+  private:
+    const char* name;
+    int64_t start;
+};
+
+// forgets everything recorded so far. only safe while no instrumented threads are running.
+inline void reset() {
+    registry::get().for_each([](thread_buffer& b) {
+        for (auto& c : b.counters)
+            c = 0;
+        b.spans.clear();
+    });
+}
+
+// writes every span as a complete ("X") event and each thread's counter totals as a counter
+// ("C") event at the end. only safe while no instrumented threads are running.
+inline bool write_chrome_trace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    int64_t end_ns = now_ns();
+    bool first = true;
+    auto separator = [&] {
+        out << (first ? "\n  " : ",\n  ");
+        first = false;
+    };
+
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    registry::get().for_each([&](const thread_buffer& b) {
+        separator();
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << b.id
+            << ", \"args\": {\"name\": \"thread " << b.id << "\"}}";
+        for (const auto& s : b.spans) {
+            separator();
+            out << "{\"name\": \"" << s.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << b.id
+                << ", \"ts\": " << s.start_ns / 1000.0 << ", \"dur\": " << s.duration_ns / 1000.0 << '}';
+        }
+        separator();
+        out << "{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, \"tid\": " << b.id
+            << ", \"ts\": " << end_ns / 1000.0 << ", \"args\": {";
+        for (int c = 0; c < int(counter::count); c++)
+            out << (c ? ", " : "") << '"' << counter_name(counter(c)) << "\": " << b.counters[c];
+        out << "}}";
+    });
+    out << "\n]}\n";
+    return bool(out);
+}
+
+// counter totals over every thread
+inline void totals(uint64_t (&out)[int(counter::count)]) {
+    for (auto& c : out)
+        c = 0;
+    registry::get().for_each([&](const thread_buffer& b) {
+        for (int c = 0; c < int(counter::count); c++)
+            out[c] += b.counters[c];
+    });
+}
+
+constexpr bool enabled = true;
+
+} // namespace instrument
+
+#define RT_INSTRUMENT_CONCAT2(a, b) a##b
+#define RT_INSTRUMENT_CONCAT(a, b) RT_INSTRUMENT_CONCAT2(a, b)
+#define RT_COUNT(c) (++::instrument::local().counters[int(::instrument::counter::c)])
+#define RT_SCOPE(name) ::instrument::scope RT_INSTRUMENT_CONCAT(rt_scope_, __LINE__)(name)
+
+#else
+
+namespace instrument {
+
+inline void reset() {}
+inline bool write_chrome_trace(const std::string&) { return false; }
+inline void totals(uint64_t (&out)[int(counter::count)]) {
+    for (auto& c : out)
+        c = 0;
+}
+
+constexpr bool enabled = false;
+
+} // namespace instrument
+
+#define RT_COUNT(c) ((void)0)
+#define RT_SCOPE(name) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include "hittable.h"
+#include "material.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/*
+The lights a scene's diffuse surfaces sample directly (next event estimation): emissive
+spheres and quads, picked in proportion to their power from an alias table, so choosing one
+costs the same with ten thousand lights as with one.
+
+A sphere is sampled uniformly over the hemisphere facing the shading point, which holds
+every point of it the shading point can see, and a quad uniformly over its area. Picking a
+light by its sampled area times its brightness makes the density of a sampled point, per
+unit area, the brightness at that point over the total for every light: the same wherever
+the point is, which is what lets a path that hits a light by bouncing into it weigh itself
+against light sampling (multiple importance sampling) without knowing which light it hit.
+That does mean every emissive surface a diffuse path can bounce into has to be in the list,
+or its light gets weighted down as though it had been sampled too.
+*/
+class light_list {
+  public:
+    void add_sphere(const point3& center, real radius, const colour& emit) {
+        add({ shape::sphere, center, vec3(), vec3(), radius, emit }, 2 * pi * radius * radius);
+    }
+
+    // the quad's front face, the one cross(u, v) points out of, is the side that's lit
+    void add_quad(const point3& q, const vec3& u, const vec3& v, const colour& emit) {
+        add({ shape::quad, q, u, v, 0, emit }, cross(u, v).length());
+    }
+
+    size_t size() const { return lights.size(); }
+    bool empty() const { return lights.empty(); }
+
+    // builds the alias table (vose's method); call once every light is in
+    void build() {
+        size_t n = lights.size();
+        total_power = 0;
+        for (real p : power)
+            total_power += p;
+        probability.assign(n, 1);
+        alias.resize(n);
+        for (size_t i = 0; i < n; i++)
+            alias[i] = int32_t(i);
+        if (n == 0)
+            return;
+
+        // each light's share scaled so the average is 1. a column with less than 1 is topped up
+        // from one with more, which becomes its alias
+        std::vector<real> scaled(n);
+        std::vector<int32_t> small, large;
+        for (size_t i = 0; i < n; i++) {
+            scaled[i] = power[i] * n / total_power;
+            (scaled[i] < 1 ? small : large).push_back(int32_t(i));
+        }
+        while (!small.empty() && !large.empty()) {
+            int32_t s = small.back(), l = large.back();
+            small.pop_back();
+            probability[s] = scaled[s];
+            alias[s] = l;
+            scaled[l] -= 1 - scaled[s];
+            if (scaled[l] < 1) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // whatever's left is 1 give or take rounding
+    }
+
+    // density, per unit area, of sample_direct picking a point on a light that gives off
+    // emit there
+    real area_pdf(const colour& emit) const {
+        return real(luminance(emit)) / total_power;
+    }
+
+    // samples a point on a light for the lambertian surface at rec, with the given albedo.
+    // returns false if the point can't light the surface (it faces away, or the surface does);
+    // otherwise direct is the light it sends, already times the brdf and cosine and weighted
+    // against brdf sampling, if the ray shadow reaches it without hitting anything in
+    // (0.001, distance).
+    bool sample_direct(const hit_record& rec, const colour& albedo, real time, sampler& samples,
+                       ray& shadow, real& distance, colour& direct) const {
+        const light& l = lights[pick(samples.get_1d())];
+        sample_2d s = samples.get_2d();
+        point3 y;
+        vec3 n;
+        if (l.type == shape::sphere) {
+            n = sphere_from_square(s.u, s.v);
+            if (dot(n, rec.p - l.corner) < 0)
+                n = -n;
+            y = l.corner + l.radius * n;
+        } else {
+            y = l.corner + real(s.u) * l.u + real(s.v) * l.v;
+            n = unit_vector(cross(l.u, l.v));
+        }
+
+        vec3 to_light = y - rec.p;
+        real distance_squared = to_light.length_squared();
+        distance = std::sqrt(distance_squared);
+        vec3 wi = to_light / distance;
+        real cos_surface = dot(rec.normal, wi);
+        real cos_light = -dot(n, wi);
+        if (cos_surface <= 0 || cos_light <= 0)
+            return false;
+
+        real light_pdf = area_pdf(l.emit) * distance_squared / cos_light; // per solid angle
+        real brdf_pdf = cos_surface / real(pi);
+        direct = (albedo / real(pi)) * l.emit * (cos_surface / light_pdf * power_heuristic(light_pdf, brdf_pdf));
+        shadow = ray(rec.spawn_origin(wi), wi, time);
+        distance -= real(0.001); // stop short of the light itself
+        return true;
+    }
+
+    // weight for light a path found by bouncing into an emitter, giving off emit, at rec,
+    // when the bounce picked r's direction with density brdf_pdf
+    real brdf_weight(const ray& r, const hit_record& rec, const colour& emit, real brdf_pdf) const {
+        real length = r.direction().length();
+        real distance = rec.t * length;
+        real cos_light = -dot(rec.normal, r.direction()) / length;
+        real light_pdf = area_pdf(emit) * distance * distance / cos_light;
+        return power_heuristic(brdf_pdf, light_pdf);
+    }
+
+    // size in bytes of the light records and alias table
+    size_t bytes() const {
+        return lights.capacity() * sizeof(light) + power.capacity() * sizeof(real)
+             + probability.capacity() * sizeof(real) + alias.capacity() * sizeof(int32_t);
+    }
+
+  private:
+    enum class shape : uint32_t { sphere, quad };
+
+    struct light {
+        shape  type;
+        point3 corner; // a sphere's centre, a quad's corner
+        vec3   u, v;   // a quad's edges
+        real   radius;
+        colour emit;
+    };
+
+    std::vector<light> lights;
+    std::vector<real> power; // sampled area times luminance
+    std::vector<real> probability;
+    std::vector<int32_t> alias;
+    real total_power = 0;
+
+    void add(const light& l, real sampled_area) {
+        real p = sampled_area * real(luminance(l.emit));
+        if (p <= 0)
+            return;
+        lights.push_back(l);
+        power.push_back(p);
+    }
+
+    // one number in [0, 1) picks the column and, with what's left of it, the light or its alias
+    int pick(double u) const {
+        real x = real(u) * lights.size();
+        int i = std::min(int(x), int(lights.size()) - 1);
+        return x - i < probability[i] ? i : alias[i];
+    }
+
+    static real power_heuristic(real pdf, real other_pdf) {
+        return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+    }
+};
+
+#endif
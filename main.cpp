@@ -1,82 +1,458 @@
 #include "rtweekend.h"
 
+#include "animation.h"
 #include "camera.h"
 #include "hittable.h"
 #include "material.h"
 #include "hittable_list.h"
 #include "sphere.h"
+#include "bvh.h"
+#include "closed_world.h"
+#include "denoise.h"
+#include "distributed.h"
+#include "sphere_soup.h"
+#include "image_writer.h"
+#include "instrument.h"
+#include "scenes.h"
+#include "scene_file.h"
 
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <memory>
+#include <string>
 
-int main() {
-    hittable_list world;
-
-    // ground
-    world.add(std::make_unique<sphere>(
-        point3(0, -1000, 0), 1000,
-        std::unique_ptr<material>( new lambertian(colour(0.5, 0.5, 0.5)) )
-    ));
-
-    // random small spheres
-    for (int a = -3; a < 3; a++) {
-        for (int b = -3; b < 3; b++) {
-            auto choose_mat = random_double();
-            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
-
-            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-                if (choose_mat < 0.8) {
-                    // diffuse
-                    auto albedo = colour::random() * colour::random();
-                    world.add(std::make_unique<sphere>(
-                        center, 0.2,
-                        std::unique_ptr<material>( new lambertian(albedo) )
-                    ));
-                } else if (choose_mat < 0.95) {
-                    // metal
-                    auto albedo = colour::random(0.5, 1);
-                    auto fuzz   = random_double(0, 0.5);
-                    world.add(std::make_unique<sphere>(
-                        center, 0.2,
-                        std::unique_ptr<material>( new metal(albedo, fuzz) )
-                    ));
-                } else {
-                    // glass
-                    world.add(std::make_unique<sphere>(
-                        center, 0.2,
-                        std::unique_ptr<material>( new dielectric(1.5) )
-                    ));
-                }
+static int usage(const char* program) {
+    std::cerr << "usage: " << program << " [--format ppm|p3|pfm|png] [--output file] [--soup]\n"
+              << "       [--integrator iterative|recursive|wavefront] [--adaptive threshold] [--heatmap file]\n"
+              << "       [--spp n] [--progressive pass_samples] [--checkpoint file]\n"
+              << "       [--scene file] [--save-scene file] [--trace file] [--progress text|json]\n"
+              << "       [--frames n] [--motion-blur] [--cornell] [--no-nee]\n"
+              << "       [--sampler independent|stratified|sobol|blue-noise] [--denoise] [--aovs file]\n"
+              << "       [--coordinator port] [--spawn n] [--worker host:port]\n"
+              << "  writes a binary ppm to stdout by default\n"
+              << "  --soup stores the spheres as a simd sphere soup instead of a bvh of objects\n"
+              << "  --integrator wavefront traces each tile's paths together, a bounce at a time\n"
+              << "  --adaptive stops sampling each pixel once its error is below threshold (e.g. 0.005)\n"
+              << "  --heatmap writes an image of the samples taken per pixel\n"
+              << "  --progressive renders in passes, rewriting --output after each one\n"
+              << "  --checkpoint saves the progressive render after each pass, and resumes from it if it exists\n"
+              << "  --scene renders a text or binary scene file instead of the built in scene\n"
+              << "  --save-scene writes the --scene file in binary form and exits (spheres only, no meshes or camera keys)\n"
+              << "  --trace writes a chrome trace of the render (needs a build with RT_INSTRUMENT)\n"
+              << "  --frames renders n frames of an animation, along the scene file's camera keys or else a\n"
+              << "    turntable, to --output with its last run of '#' replaced by the frame number\n"
+              << "  --motion-blur renders the built in scene with its small diffuse spheres bouncing\n"
+              << "  --cornell renders the built in cornell box, lit only by its own lights\n"
+              << "  --no-nee leaves lights to be found by paths bouncing into them, instead of sampling them\n"
+              << "  --sampler picks how each pixel's samples are spread (see sampler.h), independent by default\n"
+              << "  --denoise filters the finished image, guided by the albedo, normal and depth at each pixel\n"
+              << "  --aovs writes those as images too, to file with _albedo, _normal and _depth before its extension\n"
+              << "  --progress json logs progress to stderr as one json object per line, for other programs\n"
+              << "  --coordinator splits the render into units for worker processes connecting on port (0 for\n"
+              << "    any free one), and --spawn starts n of them here with the same arguments\n"
+              << "  --worker renders units for the coordinator at host:port, given the coordinator's other arguments\n";
+    return 1;
+}
+
+// path with suffix put in before its extension, if it has one
+static std::string suffixed_path(const std::string& path, const std::string& suffix) {
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = path.size();
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+static bool save_image(const std::string& path, const framebuffer& image, image_format format) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "could not open " << path << '\n';
+        return false;
+    }
+    write_image(out, image, format);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    image_format format = image_format::ppm;
+    std::string output_path;
+    bool use_soup = false;
+    integrator_type integrator = integrator_type::iterative;
+    sampler_type sampling = sampler_type::independent;
+    double adaptive_threshold = 0;
+    std::string heatmap_path;
+    int samples_per_pixel = 0;
+    int pass_samples = 0;
+    std::string checkpoint_path;
+    std::string scene_path;
+    std::string save_scene_path;
+    std::string trace_path;
+    progress_format progress_style = progress_format::text;
+    int frame_count = 0;
+    bool motion_blur = false;
+    bool cornell = false;
+    bool sample_lights = true;
+    bool denoise = false;
+    std::string aov_path;
+    int coordinator_port = -1;
+    int spawn_count = 0;
+    std::string worker_address;
+    std::vector<std::string> worker_command{ "/proc/self/exe" }; // our own arguments, less the coordinator's
+
+    for (int i = 1; i < argc; i++) {
+        const int first = i; // the argument, with its value if it takes one, ends up at argv[i]
+        std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc) {
+            if (!parse_image_format(argv[++i], format))
+                return usage(argv[0]);
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (arg == "--soup") {
+            use_soup = true;
+        } else if (arg == "--integrator" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "iterative")
+                integrator = integrator_type::iterative;
+            else if (name == "recursive")
+                integrator = integrator_type::recursive;
+            else if (name == "wavefront")
+                integrator = integrator_type::wavefront;
+            else
+                return usage(argv[0]);
+        } else if (arg == "--sampler" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "independent")
+                sampling = sampler_type::independent;
+            else if (name == "stratified")
+                sampling = sampler_type::stratified;
+            else if (name == "sobol")
+                sampling = sampler_type::sobol;
+            else if (name == "blue-noise")
+                sampling = sampler_type::blue_noise;
+            else
+                return usage(argv[0]);
+        } else if (arg == "--adaptive" && i + 1 < argc) {
+            adaptive_threshold = std::atof(argv[++i]);
+            if (adaptive_threshold <= 0)
+                return usage(argv[0]);
+        } else if (arg == "--heatmap" && i + 1 < argc) {
+            heatmap_path = argv[++i];
+        } else if (arg == "--spp" && i + 1 < argc) {
+            samples_per_pixel = std::atoi(argv[++i]);
+            if (samples_per_pixel <= 0)
+                return usage(argv[0]);
+        } else if (arg == "--progressive" && i + 1 < argc) {
+            pass_samples = std::atoi(argv[++i]);
+            if (pass_samples <= 0)
+                return usage(argv[0]);
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpoint_path = argv[++i];
+        } else if (arg == "--scene" && i + 1 < argc) {
+            scene_path = argv[++i];
+        } else if (arg == "--save-scene" && i + 1 < argc) {
+            save_scene_path = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (arg == "--motion-blur") {
+            motion_blur = true;
+        } else if (arg == "--cornell") {
+            cornell = true;
+        } else if (arg == "--no-nee") {
+            sample_lights = false;
+        } else if (arg == "--denoise") {
+            denoise = true;
+        } else if (arg == "--aovs" && i + 1 < argc) {
+            aov_path = argv[++i];
+        } else if (arg == "--frames" && i + 1 < argc) {
+            frame_count = std::atoi(argv[++i]);
+            if (frame_count <= 0)
+                return usage(argv[0]);
+        } else if (arg == "--coordinator" && i + 1 < argc) {
+            coordinator_port = std::atoi(argv[++i]);
+            if (coordinator_port < 0 || coordinator_port > 65535)
+                return usage(argv[0]);
+        } else if (arg == "--spawn" && i + 1 < argc) {
+            spawn_count = std::atoi(argv[++i]);
+            if (spawn_count <= 0)
+                return usage(argv[0]);
+        } else if (arg == "--worker" && i + 1 < argc) {
+            worker_address = argv[++i];
+        } else if (arg == "--progress" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "text")
+                progress_style = progress_format::text;
+            else if (name == "json")
+                progress_style = progress_format::json;
+            else
+                return usage(argv[0]);
+        } else {
+            return usage(argv[0]);
+        }
+
+        if (arg != "--coordinator" && arg != "--spawn" && arg != "--worker")
+            worker_command.insert(worker_command.end(), argv + first, argv + i + 1);
+    }
+
+    if (pass_samples > 0 && (adaptive_threshold > 0 || !heatmap_path.empty())) {
+        std::cerr << "--progressive can't be combined with --adaptive or --heatmap\n";
+        return 1;
+    }
+    if (!checkpoint_path.empty() && pass_samples == 0) {
+        std::cerr << "--checkpoint needs --progressive\n";
+        return 1;
+    }
+    if (!trace_path.empty() && !instrument::enabled) {
+        std::cerr << "--trace needs a build with RT_INSTRUMENT (cmake -DRT_INSTRUMENT=ON)\n";
+        return 1;
+    }
+    if (frame_count > 0 && (output_path.empty() || pass_samples > 0 || !heatmap_path.empty())) {
+        std::cerr << "--frames needs --output, and can't be combined with --progressive or --heatmap\n";
+        return 1;
+    }
+    if ((motion_blur || cornell) && (use_soup || !scene_path.empty())) {
+        std::cerr << "--motion-blur and --cornell are for the built in scenes, and can't be combined with --soup\n";
+        return 1;
+    }
+    if (motion_blur && cornell) {
+        std::cerr << "--motion-blur and --cornell are different scenes\n";
+        return 1;
+    }
+    bool distributed = coordinator_port >= 0 || !worker_address.empty();
+    if (distributed && (pass_samples > 0 || frame_count > 0 || !heatmap_path.empty() || !save_scene_path.empty())) {
+        std::cerr << "--coordinator and --worker can't be combined with --progressive, --frames, --heatmap or --save-scene\n";
+        return 1;
+    }
+    if (frame_count > 0 && (denoise || !aov_path.empty())) {
+        std::cerr << "--denoise and --aovs can't be combined with --frames\n";
+        return 1;
+    }
+    if (spawn_count > 0 && coordinator_port < 0) {
+        std::cerr << "--spawn needs --coordinator\n";
+        return 1;
+    }
+    if (!save_scene_path.empty() && scene_path.empty()) {
+        std::cerr << "--save-scene needs --scene\n";
+        return 1;
+    }
+
+    camera cam;
+    camera_path keys;
+    std::unique_ptr<hittable> scene;
+    light_list scene_lights; // a scene file's; a closed world keeps its own
+
+    if (!scene_path.empty()) {
+        // scene files come in as a sphere soup with shared materials
+        scene_desc desc;
+        std::string error;
+        auto load_start = std::chrono::steady_clock::now();
+        if (!load_scene(scene_path, desc, error)) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        size_t triangles = 0;
+        for (const auto& m : desc.meshes)
+            triangles += desc.mesh_geometry[m.geometry]->triangle_count();
+        double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+        if (progress_style == progress_format::json)
+            write_event(std::clog, "loaded", "spheres", desc.size(), "triangles", triangles, "meshes", desc.meshes.size(),
+                        "distinct_meshes", desc.mesh_geometry.size(), "materials", desc.materials.size(), "seconds", load_seconds);
+        else
+            std::clog << "Loaded " << desc.size() << " spheres, " << triangles << " triangles in " << desc.meshes.size()
+                      << " meshes (" << desc.mesh_geometry.size() << " distinct), " << desc.materials.size() << " materials in "
+                      << load_seconds << " seconds\n";
+
+        if (!save_scene_path.empty()) {
+            std::string error;
+            if (!save_binary_scene(save_scene_path, desc, error)) {
+                std::cerr << error << '\n';
+                return 1;
             }
+            return 0;
+        }
+
+        cam = desc.cam;
+        keys = desc.path;
+        scene_lights = desc.lights();
+        cam.lights = &scene_lights;
+        scene = desc.take_scene();
+    } else {
+        auto world = std::make_unique<closed_world>();
+        scene_desc soup_scene;
+
+        // identical materials are made once and shared, by the world or the soup
+        auto add_sphere = [&](const point3& center, double radius, const material_desc& m) {
+            if (use_soup)
+                soup_scene.add_sphere(center, radius, soup_scene.add_material(m));
+            else
+                world->add(center, radius, m);
+        };
+
+        if (motion_blur) {
+            bouncing_scene(add_sphere, [&](const point3& center0, const point3& center1, double radius,
+                                           const material_desc& m) {
+                world->add_moving(center0, center1, radius, m);
+            });
+            bouncing_camera(cam);
+        } else if (cornell) {
+            cornell_scene(add_sphere, [&](const point3& q, const vec3& u, const vec3& v, const material_desc& m) {
+                world->add_quad(q, u, v, m);
+            });
+            cornell_camera(cam);
+        } else {
+            book_scene(add_sphere);
+            book_camera(cam);
+        }
+
+        // bvh over the scene, so each ray tests log(n) objects rather than all of them.
+        // the soup is left flat: a few dozen spheres are quicker as one simd run than via a tree
+        if (use_soup) {
+            scene_lights = soup_scene.lights();
+            cam.lights = &scene_lights;
+            scene = soup_scene.take_world();
+        } else {
+            world->build();
+            cam.lights = &world->lights();
+            scene = std::move(world);
         }
     }
 
-    world.add(std::make_unique<sphere>(
-        point3(0, 1, 0), 1.0,
-        std::unique_ptr<material>( new dielectric(1.5) )
-    ));
+    // what the scene is, for checkpoints to tell it from others with the same bounds
+    std::string scene_name = !scene_path.empty() ? scene_path
+                           : motion_blur ? "motion-blur" : cornell ? "cornell" : use_soup ? "book soup" : "book";
 
-    world.add(std::make_unique<sphere>(
-        point3(-4, 1, 0), 1.0,
-        std::unique_ptr<material>( new lambertian(colour(0.4, 0.2, 0.1)) )
-    ));
+    // a closed world is rendered as its own type, so its hits and scatters get inlined
+    const closed_world* closed = dynamic_cast<const closed_world*>(scene.get());
 
-    world.add(std::make_unique<sphere>(
-        point3(4, 1, 0), 1.0,
-        std::unique_ptr<material>( new metal(colour(0.7, 0.6, 0.5), 0.0) )
-    ));
+    cam.integrator = integrator;
+    cam.sampling = sampling;
+    cam.progress_style = progress_style;
+    if (!sample_lights)
+        cam.lights = nullptr;
+    if (samples_per_pixel > 0)
+        cam.samples_per_pixel = samples_per_pixel;
+    if (adaptive_threshold > 0) {
+        cam.adaptive = true;
+        cam.adaptive_threshold = adaptive_threshold;
+    }
 
-    camera cam;
-    cam.aspect_ratio      = 16.0 / 9.0;
-    cam.image_width       = 1200;
-    cam.samples_per_pixel = 20; // when this is set at 500, it will take longer.
-    cam.max_depth         = 50;
-
-    cam.vfov          = 20;
-    cam.lookfrom      = point3(13, 2, 3);
-    cam.lookat        = point3(0, 0, 0);
-    cam.vup           = vec3(0, 1, 0);
-    cam.defocus_angle = 0.6;
-    cam.focus_distance = 10.0;
-
-    cam.render(world);
+    if (!worker_address.empty()) {
+        std::string error;
+        bool ok = closed ? run_worker(cam, *closed, worker_address, error)
+                         : run_worker(cam, *scene, worker_address, error);
+        if (!ok)
+            std::cerr << error << '\n';
+        return ok ? 0 : 1;
+    }
+
+    if (frame_count > 0) {
+        // the scene and the render threads are set up once for every frame
+        if (keys.empty())
+            keys = orbit(cam, frame_count);
+        auto write_frame = [&](int frame, const framebuffer& image) {
+            return save_image(frame_path(output_path, frame), image, format);
+        };
+        bool ok = closed ? render_animation(cam, keys, 0, frame_count, *closed, write_frame)
+                         : render_animation(cam, keys, 0, frame_count, *scene, write_frame);
+        if (!trace_path.empty() && !instrument::write_chrome_trace(trace_path)) {
+            std::cerr << "could not write " << trace_path << '\n';
+            return 1;
+        }
+        return ok ? 0 : 1;
+    }
+
+    // a single render fills the aovs itself; progressive and distributed ones get a pass of
+    // their own first
+    aov_buffers aovs;
+    bool want_aovs = denoise || !aov_path.empty();
+    if (want_aovs && (pass_samples > 0 || coordinator_port >= 0))
+        aovs = closed ? cam.render_aovs(*closed) : cam.render_aovs(*scene);
+    else if (want_aovs)
+        cam.aovs = &aovs;
+
+    framebuffer image;
+    if (pass_samples > 0) {
+        accumulator accum(cam.image_width, cam.rendered_height(), cam.fingerprint(scene->bounding_box(), scene_name));
+        if (!checkpoint_path.empty()) {
+            std::string error;
+            bool resumed = accum.load(checkpoint_path, error);
+            if (!resumed && !error.empty()) {
+                std::cerr << error << '\n';
+                return 1;
+            }
+            if (resumed && progress_style == progress_format::json)
+                write_event(std::clog, "resuming", "checkpoint", checkpoint_path, "samples", accum.samples());
+            else if (resumed)
+                std::clog << "Resuming from " << checkpoint_path << " at " << accum.samples() << " samples\n";
+        }
+
+        while (accum.samples() < cam.samples_per_pixel) {
+            int pass = std::min(pass_samples, cam.samples_per_pixel - accum.samples());
+            if (closed)
+                cam.render_pass(*closed, accum, pass);
+            else
+                cam.render_pass(*scene, accum, pass);
+            if (progress_style == progress_format::json)
+                write_event(std::clog, "pass_done", "samples", accum.samples(), "samples_per_pixel", cam.samples_per_pixel);
+            else
+                std::clog << "Pass done: " << accum.samples() << " / " << cam.samples_per_pixel << " samples\n";
+
+            // checkpoint then preview, so a kill at any point loses at most one pass
+            if (!checkpoint_path.empty() && !accum.save(checkpoint_path)) {
+                if (progress_style == progress_format::json)
+                    write_event(std::cerr, "checkpoint_failed", "checkpoint", checkpoint_path);
+                else
+                    std::cerr << "could not write checkpoint " << checkpoint_path << '\n';
+            }
+            if (!output_path.empty())
+                save_image(output_path, accum.resolve(), format);
+        }
+        image = accum.resolve();
+    } else if (coordinator_port >= 0) {
+        coordinator_options options;
+        options.port = coordinator_port;
+        options.spawn = spawn_count;
+        options.worker_command = worker_command;
+        std::string error;
+        bool ok = closed ? render_distributed(cam, *closed, options, image, error)
+                         : render_distributed(cam, *scene, options, image, error);
+        if (!ok) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+    } else {
+        image = closed ? cam.render(*closed) : cam.render(*scene);
+    }
+
+    if (!trace_path.empty() && !instrument::write_chrome_trace(trace_path)) {
+        std::cerr << "could not write " << trace_path << '\n';
+        return 1;
+    }
+
+    if (!heatmap_path.empty() && !save_image(heatmap_path, cam.sample_heatmap(), format))
+        return 1;
+
+    if (!aov_path.empty()) {
+        if (!save_image(suffixed_path(aov_path, "_albedo"), aovs.albedo, format)
+            || !save_image(suffixed_path(aov_path, "_normal"), aovs.normal_image(), format)
+            || !save_image(suffixed_path(aov_path, "_depth"), aovs.depth_image(), format))
+            return 1;
+    }
+
+    if (denoise) {
+        auto start = std::chrono::steady_clock::now();
+        denoiser filter;
+        image = filter.denoise(image, aovs);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (progress_style == progress_format::json)
+            write_event(std::clog, "denoised", "seconds", seconds);
+        else
+            std::clog << "Denoised in " << seconds << " seconds\n";
+    }
+
+    if (output_path.empty()) {
+        write_image(std::cout, image, format);
+    } else if (!save_image(output_path, image, format)) {
+        return 1;
+    }
 }
\ No newline at end of file
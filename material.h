@@ -3,95 +3,133 @@
 
 
 #include "hittable.h"
+#include "instrument.h"
+#include "sampler.h"
+
+#include <cstdint>
+#include <memory>
+#include <variant>
+
+// the materials the wavefront integrator shades without a virtual call, see wavefront.h.
+// anything else is 'other' and goes through scatter as usual.
+enum class material_kind : uint32_t { lambertian, metal, dielectric, emissive, other };
 
 class material {
   public:
+    const material_kind kind;
+
+    explicit material(material_kind kind = material_kind::other) : kind(kind) {}
     virtual ~material() = default;
 
     virtual bool scatter(const ray& r_in,
                         const hit_record& rec,
                         colour& attenuation,
-                        ray& scattered) const {return false;}
+                        ray& scattered,
+                        sampler& samples) const {return false;}
 };
 
-class lambertian : public material {
+class lambertian final : public material {
   public:
-    lambertian(const colour& a) : albedo(a) {}
+    lambertian(const colour& a) : material(material_kind::lambertian), albedo(a) {}
 
     bool scatter(const ray& r_in,
                         const hit_record& rec,
                         colour& attenuation,
-                        ray& scattered) 
+                        ray& scattered,
+                        sampler& samples) 
     const override {
-        vec3 scatter_direction = rec.normal + random_unit_vector();
+        RT_COUNT(scatter_lambertian);
+        sample_2d s = samples.get_2d();
+        vec3 scatter_direction = rec.normal + sphere_from_square(s.u, s.v);
 
         // Catch degenerate scatter direction
         if (scatter_direction.near_zero())
             scatter_direction = rec.normal;
 
             
-        scattered = ray(rec.p, scatter_direction);
+        scattered = ray(rec.spawn_origin(scatter_direction), scatter_direction, r_in.time());
         attenuation = albedo;
         return true;
     }
 
+    // density of scatter picking scattered's direction, per solid angle: the cosine over pi
+    static real pdf(const hit_record& rec, const ray& scattered) {
+        return std::fmax(real(0), dot(rec.normal, unit_vector(scattered.direction()))) / real(pi);
+    }
+
   public:
     colour albedo;
 };
 
-class metal : public material {
+class metal final : public material {
   public:
-    metal(const colour& a, double fuzz) : albedo(a), fuzz(fuzz < 1 ? fuzz : 1) {}
+    metal(const colour& a, real fuzz) : material(material_kind::metal), albedo(a), fuzz(fuzz < 1 ? fuzz : 1) {}
 
     bool scatter(const ray& r_in,
                         const hit_record& rec,
                         colour& attenuation,
-                        ray& scattered) 
+                        ray& scattered,
+                        sampler& samples) 
     const override {
+        RT_COUNT(scatter_metal);
         vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-        scattered = ray(rec.p, reflected);
+        scattered = ray(rec.spawn_origin(reflected), reflected, r_in.time());
         attenuation = albedo;
         return true;
     }
 
   public:
     colour albedo;
-    double fuzz;
+    real fuzz;
 };
 
-class dielectric : public material {
+class dielectric final : public material {
   public:
-    dielectric(double ri) : refraction_index(ri) {}
+    dielectric(real ri) : material(material_kind::dielectric), refraction_index(ri) {}
 
     bool scatter(const ray& r_in,
                         const hit_record& rec,
                         colour& attenuation,
-                        ray& scattered)
+                        ray& scattered,
+                        sampler& samples)
     const override {
+      RT_COUNT(scatter_dielectric);
       attenuation = colour(1.0, 1.0, 1.0);
-      double ri = rec.front_face ? (1.0/refraction_index) : refraction_index;
+      real ri = rec.front_face ? (1/refraction_index) : refraction_index;
 
       vec3 unit_direction = unit_vector(r_in.direction());
       //  handling for total intel reflection
-      double cos_theta = std::fmin(dot(-unit_direction, rec.normal), 1.0);
-      double sin_theta = std::sqrt(1.0 - cos_theta*cos_theta);
+      real cos_theta = std::fmin(dot(-unit_direction, rec.normal), real(1));
+      real sin_theta = std::sqrt(1 - cos_theta*cos_theta);
 
       bool cannot_refract = ri * sin_theta > 1.0;
       vec3 direction;
 
-      if (cannot_refract || reflectance(cos_theta, ri) > random_double())
+      if (cannot_refract || reflectance(cos_theta, ri) > samples.get_1d())
         direction = reflect(unit_direction, rec.normal);
       else
         direction = refract(unit_direction, rec.normal, ri);
 
-      scattered = ray(rec.p, direction);
+      scattered = ray(rec.spawn_origin(direction), direction, r_in.time());
       return true;
     }
 
+    // the way most light through the surface goes, with no random choice: refracted, unless
+    // it can't be
+    ray transmitted(const ray& r_in, const hit_record& rec) const {
+      real ri = rec.front_face ? (1/refraction_index) : refraction_index;
+      vec3 unit_direction = unit_vector(r_in.direction());
+      real cos_theta = std::fmin(dot(-unit_direction, rec.normal), real(1));
+      real sin_theta = std::sqrt(1 - cos_theta*cos_theta);
+      vec3 direction = ri * sin_theta > 1.0 ? reflect(unit_direction, rec.normal)
+                                            : refract(unit_direction, rec.normal, ri);
+      return ray(rec.spawn_origin(direction), direction, r_in.time());
+    }
+
   private:
-    double refraction_index;
+    real refraction_index;
 
-    static double reflectance(double cosine, double refraction_index) {
+    static real reflectance(real cosine, real refraction_index) {
       // this uses Schlick's approximation for reflectance (simply polynomial)
       auto r0 = (1 - refraction_index) / (1 + refraction_index);
       r0 = r0*r0;
@@ -100,4 +138,116 @@ class dielectric : public material {
 
 };
 
+/*
+A surface that gives off light from its front face and reflects none. The integrators
+check for the emissive kind and read emitted directly, and a path ends where it hits one.
+For a light to be sampled directly it also has to be in the camera's light_list (see
+lights.h); emitters that aren't are only found by paths bouncing into them.
+*/
+class diffuse_light final : public material {
+  public:
+    diffuse_light(const colour& emit) : material(material_kind::emissive), emit(emit) {}
+
+    // radiance leaving the hit point back along the ray
+    colour emitted(const hit_record& rec) const {
+        return rec.front_face ? emit : colour(0, 0, 0);
+    }
+
+  public:
+    colour emit;
+};
+
+// the closed set of materials held by value, for worlds that store their materials inline
+// rather than behind pointers (see closed_world.h)
+using material_variant = std::variant<lambertian, metal, dielectric, diffuse_light>;
+
+// scatter picked by a switch on the material's kind instead of the vtable. the classes are
+// final, so each case is a direct call the compiler can inline into the integrator.
+inline bool scatter_closed(const material& m, const ray& r_in, const hit_record& rec,
+                           colour& attenuation, ray& scattered, sampler& samples) {
+    switch (m.kind) {
+        case material_kind::lambertian:
+            return static_cast<const lambertian&>(m).scatter(r_in, rec, attenuation, scattered, samples);
+        case material_kind::metal:
+            return static_cast<const metal&>(m).scatter(r_in, rec, attenuation, scattered, samples);
+        case material_kind::dielectric:
+            return static_cast<const dielectric&>(m).scatter(r_in, rec, attenuation, scattered, samples);
+        case material_kind::emissive:
+            return false;
+        default:
+            return m.scatter(r_in, rec, attenuation, scattered, samples);
+    }
+}
+
+/*
+Material parameters by value, for the closed set of materials above. Lets scenes be
+described without allocating, and identical materials be found and shared.
+*/
+struct material_desc {
+    using kind = material_kind;
+
+    kind   type = kind::lambertian;
+    colour albedo = colour(0.5, 0.5, 0.5); // for emissive, the radiance given off
+    double fuzz = 0;
+    double refraction_index = 1;
+
+    static material_desc make_lambertian(const colour& albedo) {
+        material_desc m;
+        m.albedo = albedo;
+        return m;
+    }
+    static material_desc make_metal(const colour& albedo, double fuzz) {
+        material_desc m;
+        m.type = kind::metal;
+        m.albedo = albedo;
+        m.fuzz = fuzz;
+        return m;
+    }
+    static material_desc make_dielectric(double refraction_index) {
+        material_desc m;
+        m.type = kind::dielectric;
+        m.refraction_index = refraction_index;
+        return m;
+    }
+    static material_desc make_emissive(const colour& emit) {
+        material_desc m;
+        m.type = kind::emissive;
+        m.albedo = emit;
+        return m;
+    }
+
+    bool operator==(const material_desc& o) const {
+        return type == o.type && albedo.x() == o.albedo.x() && albedo.y() == o.albedo.y()
+            && albedo.z() == o.albedo.z() && fuzz == o.fuzz && refraction_index == o.refraction_index;
+    }
+
+    std::unique_ptr<material> make() const {
+        switch (type) {
+            case kind::metal:      return std::make_unique<metal>(albedo, fuzz);
+            case kind::dielectric: return std::make_unique<dielectric>(refraction_index);
+            case kind::emissive:   return std::make_unique<diffuse_light>(albedo);
+            default:               return std::make_unique<lambertian>(albedo);
+        }
+    }
+
+    material_variant make_variant() const {
+        switch (type) {
+            case kind::metal:      return metal(albedo, fuzz);
+            case kind::dielectric: return dielectric(refraction_index);
+            case kind::emissive:   return diffuse_light(albedo);
+            default:               return lambertian(albedo);
+        }
+    }
+};
+
+struct material_desc_hash {
+    size_t operator()(const material_desc& m) const {
+        const double values[6] = { m.albedo.x(), m.albedo.y(), m.albedo.z(), m.fuzz, m.refraction_index, double(m.type) };
+        size_t h = 0;
+        for (double v : values)
+            h = h * 1000003u ^ std::hash<double>()(v);
+        return h;
+    }
+};
+
 #endif
@@ -0,0 +1,142 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "bvh.h"
+#include "hittable.h"
+#include "instrument.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+A triangle mesh as one hittable: shared vertex and index buffers, three indices per
+triangle, and a bvh over the triangles of its own. The mesh sits in a scene's list or bvh as
+a single object, so a model with hundreds of thousands of faces costs the outer bvh one leaf
+and each face costs 12 bytes of indices, plus its vertices' share, plus the tree.
+
+Triangles are flat shaded with their geometric normal, whose winding (counter-clockwise
+seen from the front, as in obj files) only decides front_face.
+*/
+class triangle_mesh final : public hittable {
+  public:
+    std::vector<point3> vertices;
+    std::vector<int32_t> indices; // three per triangle, into vertices
+
+    triangle_mesh() = default;
+    // the material isn't owned, see sphere
+    explicit triangle_mesh(const material* material_ptr) : material_ptr(material_ptr) {}
+
+    void set_material(const material* m) { material_ptr = m; }
+
+    size_t triangle_count() const { return indices.size() / 3; }
+
+    // builds the bvh and sorts the triangles into its leaf order. call once every triangle
+    // is in, and before the mesh goes into a list or bvh, which ask for its bounding box.
+    void build(int max_leaf_size = 4) {
+        size_t n = triangle_count();
+        std::vector<aabb> boxes(n);
+        for (size_t i = 0; i < n; i++) {
+            const point3& a = vertices[indices[3*i]];
+            const point3& b = vertices[indices[3*i + 1]];
+            const point3& c = vertices[indices[3*i + 2]];
+            boxes[i] = pad(aabb(aabb(a, b), aabb(c, c)));
+        }
+
+        auto order = tree.build(boxes, max_leaf_size);
+
+        std::vector<int32_t> sorted(indices.size());
+        for (size_t i = 0; i < n; i++)
+            for (int k = 0; k < 3; k++)
+                sorted[3*i + k] = indices[3*size_t(order[i]) + k];
+        indices = std::move(sorted);
+    }
+
+    // the traversal only keeps the closest triangle's index and distance; the hit point and
+    // normal are left to surface, for that triangle alone and only if it's still the closest
+    // hit once the rest of the scene has been tried
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        int closest = -1;
+        real closest_t = ray_t.max;
+        tree.traverse(r, ray_t, [&](int first, int count, interval& t) {
+            bool hit_anything = false;
+            for (int i = first; i < first + count; i++) {
+                real hit_t;
+                if (hit_triangle(i, r, t, hit_t)) {
+                    hit_anything = true;
+                    t.max = closest_t = hit_t;
+                    closest = i;
+                }
+            }
+            return hit_anything;
+        });
+        if (closest < 0)
+            return false;
+
+        rec.t = closest_t;
+        rec.object = this;
+        rec.primitive = closest;
+        return true;
+    }
+
+    void surface(const ray& r, hit_record& rec) const override {
+        const point3& a = vertices[indices[3*rec.primitive]];
+        const point3& b = vertices[indices[3*rec.primitive + 1]];
+        const point3& c = vertices[indices[3*rec.primitive + 2]];
+        rec.p = r.at(rec.t);
+        rec.set_face_normal(r, unit_vector(cross(b - a, c - a)));
+        rec.material_ptr = material_ptr;
+    }
+
+    aabb bounding_box() const override { return tree.bounding_box(); }
+
+    size_t node_count() const { return tree.nodes.size(); }
+
+    size_t bytes() const {
+        return vertices.capacity() * sizeof(point3) + indices.capacity() * sizeof(int32_t)
+             + tree.nodes.capacity() * sizeof(bvh_node);
+    }
+
+  private:
+    const material* material_ptr = nullptr;
+    bvh_tree tree;
+
+    // moller-trumbore: solves for the hit's barycentrics u, v and distance t together, with
+    // early outs as soon as u or v falls outside the triangle
+    bool hit_triangle(int i, const ray& r, const interval& ray_t, real& t) const {
+        RT_COUNT(triangle_hit);
+        const point3& a = vertices[indices[3*i]];
+        vec3 e1 = vertices[indices[3*i + 1]] - a;
+        vec3 e2 = vertices[indices[3*i + 2]] - a;
+
+        vec3 pvec = cross(r.direction(), e2);
+        real det = dot(e1, pvec);
+        if (det == 0) // ray parallel to the triangle
+            return false;
+        real inv_det = 1 / det;
+
+        vec3 tvec = r.origin() - a;
+        real u = dot(tvec, pvec) * inv_det;
+        if (u < 0 || u > 1)
+            return false;
+
+        vec3 qvec = cross(tvec, e1);
+        real v = dot(r.direction(), qvec) * inv_det;
+        if (v < 0 || u + v > 1)
+            return false;
+
+        t = dot(e2, qvec) * inv_det;
+        return ray_t.surrounds(t);
+    }
+
+    // axis-aligned triangles have flat boxes, which the slab test can miss at grazing
+    // angles; give every axis a little thickness
+    static aabb pad(const aabb& box) {
+        auto grow = [](const interval& i) {
+            real delta = real(1e-4) * std::fmax(real(1), std::fmax(std::fabs(i.min), std::fabs(i.max)));
+            return i.size() < delta ? interval(i.min - delta / 2, i.max + delta / 2) : i;
+        };
+        return aabb(grow(box.x), grow(box.y), grow(box.z));
+    }
+};
+
+#endif
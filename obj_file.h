@@ -0,0 +1,150 @@
+#ifndef OBJ_FILE_H
+#define OBJ_FILE_H
+
+#include "mesh.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+Wavefront obj files, the geometry only: 'v' vertices and 'f' faces. Faces with more than
+three corners are split into a fan of triangles; indices may be negative (counted back from
+the last vertex) and may carry texture and normal indices ("f 1/4/2 ..."), which are
+skipped along with every other statement.
+
+The file is read in fixed size blocks and parsed in place, line by line, straight into the
+mesh's vertex and index arrays, so the only allocations are those arrays growing.
+*/
+
+namespace obj_file_detail {
+
+inline void skip_spaces(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+}
+
+inline bool parse_real(const char*& p, const char* end, double& value) {
+    skip_spaces(p, end);
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc())
+        return false;
+    p = result.ptr;
+    return true;
+}
+
+// a face corner's vertex index, turned into a zero based one, skipping any /vt/vn after it
+inline bool parse_corner(const char*& p, const char* end, size_t vertex_count, int32_t& index) {
+    long long i;
+    auto result = std::from_chars(p, end, i);
+    if (result.ec != std::errc() || i == 0)
+        return false;
+    p = result.ptr;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+        p++;
+
+    i = i > 0 ? i - 1 : (long long)(vertex_count) + i;
+    if (i < 0 || (size_t)i >= vertex_count)
+        return false;
+    index = int32_t(i);
+    return true;
+}
+
+inline bool parse_line(const char* p, const char* end, triangle_mesh& mesh) {
+    skip_spaces(p, end);
+    if (end - p < 2 || (p[1] != ' ' && p[1] != '\t'))
+        return true; // blank, comment or a statement we don't use (vn, vt, usemtl, ...)
+
+    if (p[0] == 'v') {
+        p++;
+        double x, y, z;
+        if (!parse_real(p, end, x) || !parse_real(p, end, y) || !parse_real(p, end, z))
+            return false;
+        mesh.vertices.emplace_back(x, y, z); // anything after (w, or vertex colours) ignored
+        return true;
+    }
+
+    if (p[0] == 'f') {
+        p++;
+        int32_t first = 0, previous = 0, corner;
+        int corners = 0;
+        while (true) {
+            skip_spaces(p, end);
+            if (p == end)
+                break;
+            if (!parse_corner(p, end, mesh.vertices.size(), corner))
+                return false;
+            if (corners == 0) {
+                first = corner;
+            } else if (corners >= 2) {
+                mesh.indices.push_back(first);
+                mesh.indices.push_back(previous);
+                mesh.indices.push_back(corner);
+            }
+            previous = corner;
+            corners++;
+        }
+        return corners >= 3;
+    }
+
+    return true;
+}
+
+} // namespace obj_file_detail
+
+// appends the triangles of an obj file to mesh (without building its bvh)
+inline bool load_obj(const std::string& path, triangle_mesh& mesh, std::string& error) {
+    using namespace obj_file_detail;
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        error = "can't read " + path;
+        return false;
+    }
+
+    // block plus room for the partial line carried over from the previous block
+    constexpr size_t block_size = size_t(1) << 20;
+    std::vector<char> buffer(2 * block_size);
+    size_t carried = 0;
+    int line_number = 0;
+
+    while (true) {
+        in.read(buffer.data() + carried, std::streamsize(block_size));
+        size_t filled = carried + size_t(in.gcount());
+        bool last_block = in.gcount() == 0 || !in;
+        if (filled == 0)
+            break;
+
+        const char* p = buffer.data();
+        const char* end = p + filled;
+        while (p < end) {
+            const char* eol = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+            if (!eol && !last_block)
+                break; // partial line, finish it with the next block
+            const char* line_end = eol ? eol : end;
+            line_number++;
+            if (!parse_line(p, line_end, mesh)) {
+                error = path + ": line " + std::to_string(line_number) + ": can't parse '"
+                      + std::string(p, size_t(std::min<ptrdiff_t>(line_end - p, 80))) + "'";
+                return false;
+            }
+            p = eol ? eol + 1 : end;
+        }
+
+        carried = size_t(end - p);
+        if (carried > block_size) {
+            error = path + ": line " + std::to_string(line_number + 1) + " is too long";
+            return false;
+        }
+        std::memmove(buffer.data(), p, carried);
+        if (last_block && carried == 0)
+            break;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+// text is a single line rewritten in place for people; json is one object per line for
+// whatever is running the renderer, e.g.
+// {"progress": 0.42, "tiles": 1520, "total_tiles": 3600, "elapsed_seconds": 3.1, "eta_seconds": 4.3, "rays_per_second": 5.2e+06}
+// with everything else the renderer logs as events in the same form (see write_event)
+enum class progress_format { text, json };
+
+namespace progress_detail {
+
+inline void write_json(std::ostream& out, std::string_view text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c == '\n')
+            out << "\\n";
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << ' ';
+        else
+            out << c;
+    }
+    out << '"';
+}
+
+template <typename T>
+void write_json(std::ostream& out, const T& value) {
+    if constexpr (std::is_same_v<T, bool>)
+        out << (value ? "true" : "false");
+    else if constexpr (std::is_arithmetic_v<T>)
+        out << value;
+    else
+        write_json(out, std::string_view(value));
+}
+
+inline void write_fields(std::ostream&) {}
+
+template <typename T, typename... Rest>
+void write_fields(std::ostream& out, const char* key, const T& value, const Rest&... rest) {
+    out << ", \"" << key << "\": ";
+    write_json(out, value);
+    write_fields(out, rest...);
+}
+
+} // namespace progress_detail
+
+// what else a render has to say, when progress is json: one object per line like the
+// progress reports, {"event": name, key: value, ...}, with the keys and values given in
+// turn. the line goes out in one write, so it can't be split by a progress report from the
+// reporter's thread. text mode callers print their own sentence instead.
+template <typename... Fields>
+void write_event(std::ostream& out, const char* name, const Fields&... fields) {
+    std::ostringstream line;
+    line << "{\"event\": \"" << name << '"';
+    progress_detail::write_fields(line, fields...);
+    line << "}\n";
+    out << line.str() << std::flush;
+}
+
+/*
+Render progress. Workers only ever bump two relaxed atomic counters when they finish a tile;
+a reporter thread of its own samples them at a fixed rate and does all the formatting and
+I/O, so printing progress never holds up a worker.
+*/
+class progress_reporter {
+  public:
+    progress_reporter(int total_tiles, progress_format format, std::ostream& out,
+                      std::chrono::milliseconds interval = std::chrono::milliseconds(250))
+        : total_tiles(total_tiles), format(format), out(out), interval(interval),
+          start(clock::now()), last_time(start), thread([this] { run(); }) {}
+
+    ~progress_reporter() { stop(); }
+
+    progress_reporter(const progress_reporter&) = delete;
+    progress_reporter& operator=(const progress_reporter&) = delete;
+
+    // called by a worker for each finished tile, with the rays it traced
+    void tile_done(uint64_t rays) {
+        tiles.fetch_add(1, std::memory_order_relaxed);
+        ray_count.fetch_add(rays, std::memory_order_relaxed);
+    }
+
+    // prints the final report and stops the reporter thread
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (stopping)
+                return;
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    // each counter on its own cache line, apart from the reporter's state
+    alignas(64) std::atomic<int> tiles{0};
+    alignas(64) std::atomic<uint64_t> ray_count{0};
+
+    alignas(64) const int total_tiles;
+    const progress_format format;
+    std::ostream& out;
+    const std::chrono::milliseconds interval;
+
+    clock::time_point start;
+    clock::time_point last_time; // of the previous report, for the current ray rate
+    uint64_t last_rays = 0;
+
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread; // last, so everything above is set up before it starts
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!wake.wait_for(lock, interval, [this] { return stopping; }))
+            report(false);
+        report(true);
+    }
+
+    void report(bool final) {
+        int done = tiles.load(std::memory_order_relaxed);
+        uint64_t rays = ray_count.load(std::memory_order_relaxed);
+        auto now = clock::now();
+
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        double since_last = std::chrono::duration<double>(now - last_time).count();
+        // the final report gives the average over the render, the others the current rate
+        double rate = final ? (elapsed > 0 ? rays / elapsed : 0)
+                            : (since_last > 0 ? (rays - last_rays) / since_last : 0);
+        double fraction = total_tiles > 0 ? double(done) / total_tiles : 1;
+        double eta = done > 0 ? elapsed * (total_tiles - done) / done : -1;
+        last_time = now;
+        last_rays = rays;
+
+        if (format == progress_format::json) {
+            std::ostringstream line; // written in one go, like write_event
+            line << "{\"progress\": " << fraction << ", \"tiles\": " << done << ", \"total_tiles\": " << total_tiles
+                 << ", \"elapsed_seconds\": " << elapsed << ", \"eta_seconds\": " << (final ? 0 : eta)
+                 << ", \"rays_per_second\": " << rate << (final ? ", \"done\": true" : "") << "}\n";
+            out << line.str() << std::flush;
+            return;
+        }
+
+        char line[128];
+        if (final)
+            std::snprintf(line, sizeof(line), "\rProgress 100.0%%  %.2fs  %.2f Mrays/s        \n", elapsed, rate / 1e6);
+        else if (eta < 0)
+            std::snprintf(line, sizeof(line), "\rProgress %5.1f%%  ETA --  %.2f Mrays/s   ", 100 * fraction, rate / 1e6);
+        else
+            std::snprintf(line, sizeof(line), "\rProgress %5.1f%%  ETA %.1fs  %.2f Mrays/s   ", 100 * fraction, eta, rate / 1e6);
+        out << line << std::flush;
+    }
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef QUAD_H
+#define QUAD_H
+
+#include "hittable.h"
+#include "instrument.h"
+
+/*
+A parallelogram: corner q and the edges u and v from it. Its front face is the one
+cross(u, v) points out of, which for an emissive quad is the side that gives off light.
+Hit test: the ray meets the quad's plane, then the hit's coordinates along u and v (found
+with w, which saves two divisions per hit) both have to be in [0, 1].
+*/
+class quad final : public hittable {
+  public:
+    // the material isn't owned, see sphere
+    quad(const point3& q, const vec3& u, const vec3& v, const material* material_ptr)
+        : q(q), u(u), v(v), material_ptr(material_ptr) {
+        vec3 n = cross(u, v);
+        normal = unit_vector(n);
+        d = dot(normal, q);
+        w = n / dot(n, n);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        RT_COUNT(quad_hit);
+        real denom = dot(normal, r.direction());
+        if (std::fabs(denom) < real(1e-8)) // parallel to the plane
+            return false;
+
+        real t = (d - dot(normal, r.origin())) / denom;
+        if (!ray_t.surrounds(t))
+            return false;
+
+        vec3 planar = r.at(t) - q;
+        real alpha = dot(w, cross(planar, v));
+        real beta = dot(w, cross(u, planar));
+        if (alpha < 0 || alpha > 1 || beta < 0 || beta > 1)
+            return false;
+
+        rec.t = t;
+        rec.object = this;
+        return true;
+    }
+
+    void surface(const ray& r, hit_record& rec) const override {
+        rec.p = r.at(rec.t);
+        rec.set_face_normal(r, normal);
+        rec.material_ptr = material_ptr;
+    }
+
+    // flat along the normal, so padded a little like mesh triangles' boxes
+    aabb bounding_box() const override {
+        aabb box(aabb(q, q + u + v), aabb(q + u, q + v));
+        auto grow = [](const interval& i) {
+            real delta = real(1e-4) * std::fmax(real(1), std::fmax(std::fabs(i.min), std::fabs(i.max)));
+            return i.size() < delta ? interval(i.min - delta / 2, i.max + delta / 2) : i;
+        };
+        return aabb(grow(box.x), grow(box.y), grow(box.z));
+    }
+
+  private:
+    point3 q;
+    vec3 u, v;
+    vec3 normal;
+    real d; // the plane is dot(normal, p) = d
+    vec3 w;
+    const material* material_ptr;
+};
+
+#endif
@@ -3,25 +3,56 @@
 
 #include "vec3.h"
 
-class ray {
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+template <typename T>
+class ray_t {
     public: 
-        ray() {}
+        ray_t() {}
 
-        ray (const point3& origin, const vec3& direction)
-            : orig(origin), dir(direction)
+        ray_t(const vec3_t<T>& origin, const vec3_t<T>& direction, T time = 0)
+            : orig(origin), dir(direction), tm(time)
             {}
 
 
-        const point3& origin() const { return orig; }
-        const vec3& direction() const { return dir; }
+        const vec3_t<T>& origin() const { return orig; }
+        const vec3_t<T>& direction() const { return dir; }
+        T time() const { return tm; } // when in the shutter interval the ray was sent
 
-        point3 at(double t) const {
+        vec3_t<T> at(T t) const {
             return orig + t*dir;
         }
 
     private:
-        point3 orig; 
-        vec3 dir;
+        vec3_t<T> orig; 
+        vec3_t<T> dir;
+        T tm = 0;
 };
 
+using ray = ray_t<real>;
+
+// pushes a point computed on a surface off it along n, the normal on the side a new ray will
+// leave from, so rounding in p can't put the ray's origin back behind the surface. the push
+// is a fixed number of ulps of each coordinate (a fixed distance near the origin, where ulps
+// get tiny), after Wachter and Binder, "A Fast and Robust Method for Avoiding
+// Self-Intersection", Ray Tracing Gems ch. 6.
+template <typename T>
+inline vec3_t<T> offset_ray_origin(const vec3_t<T>& p, const vec3_t<T>& n) {
+    using bits = std::conditional_t<sizeof(T) == 4, int32_t, int64_t>;
+    constexpr T origin = T(1) / 32;
+    constexpr T float_scale = 128 * std::numeric_limits<T>::epsilon();
+    constexpr T int_scale = 256;
+
+    vec3_t<T> out;
+    for (int a = 0; a < 3; a++) {
+        bits offset = bits(int_scale * n[a]);
+        bits p_bits = std::bit_cast<bits>(p[a]);
+        T p_int = std::bit_cast<T>(p_bits + (p[a] < 0 ? -offset : offset));
+        out[a] = std::fabs(p[a]) < origin ? p[a] + float_scale * n[a] : p_int;
+    }
+    return out;
+}
+
 #endif
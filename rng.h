@@ -0,0 +1,56 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+/*
+PCG32 random number generator (https://www.pcg-random.org).
+16 bytes of state and a handful of integer ops per number, so every render thread
+(or every pixel sample) can cheaply own one instead of sharing a global engine.
+*/
+class pcg32 {
+  public:
+    pcg32() : pcg32(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL) {}
+
+    pcg32(uint64_t seed, uint64_t stream) {
+        state = 0;
+        inc = (stream << 1) | 1; // increment must be odd
+        next_uint();
+        state += seed;
+        next_uint();
+    }
+
+    // independent stream for one camera sample. hashing (frame, pixel, sample) means the
+    // numbers a sample sees never depend on which thread rendered it or in what order.
+    static pcg32 for_sample(uint64_t frame, uint64_t pixel, uint64_t sample) {
+        uint64_t h = mix(mix(mix(frame) ^ pixel) ^ sample);
+        return pcg32(h, mix(h));
+    }
+
+    uint32_t next_uint() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = uint32_t(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+    // real in [0,1)
+    double next_double() {
+        return next_uint() * 0x1p-32;
+    }
+
+  private:
+    uint64_t state;
+    uint64_t inc;
+
+    // splitmix64 finaliser, spreads nearby inputs over the whole seed space
+    static uint64_t mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+};
+
+#endif
@@ -3,16 +3,24 @@
 
 #include <cmath>
 #include <iostream>
-#include <random>
 #include <limits>
 #include <memory>
 
+#include "rng.h"
 
 // c++ Std Usings
 
 using std::make_shared;
 using std::shared_ptr;
 
+// scalar type of the math core (vec3, ray, interval and everything built on them).
+// double unless built with RT_FLOAT, see the image_renderer_float target.
+#ifdef RT_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 // consts
 
 const double infinity = std::numeric_limits<double>::infinity();
@@ -24,11 +32,21 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+inline double random_double(pcg32& rng) {
+    // Returns a random real in [0,1) from the caller's stream
+    return rng.next_double();
+}
+
+inline double random_double(pcg32& rng, double min, double max) {
+    // Returns a random real within [min,max)
+    return min + (max - min) * rng.next_double();
+}
+
 inline double random_double() {
-    // Returns a random real in [0,1)
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    // Returns a random real in [0,1) from this thread's own stream, for scene setup etc.
+    // render code should use a per-sample stream instead so output is reproducible
+    thread_local pcg32 generator;
+    return random_double(generator);
 }
 
 inline double random_double(double min, double max) {
@@ -0,0 +1,301 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rng.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/*
+Where a camera sample's numbers come from. Everything random about a sample (where in the
+pixel, where on the lens, when in the shutter, and for each bounce which light, where on it,
+which direction and whether the path goes on) asks the sample's sampler for its next
+dimension, one or two numbers at a time, in the order the path needs them. How those
+numbers are spread over a pixel's samples is the sampler's type:
+
+    independent  uniform random numbers, from the sample's own pcg32 stream
+    stratified   each dimension split into as many strata as samples (2d ones into the
+                 largest square grid that fits), each sample in its own stratum, shuffled
+                 per pixel and dimension; samples past the grid are independent
+    sobol        the first two dimensions of the sobol sequence, owen scrambled and with
+                 the sample order shuffled per pixel and dimension (burley, "practical
+                 hash-based owen scrambling", 2020). best at power of two sample counts
+    blue_noise   the same scrambled sobol points in every pixel, each pixel's shifted by
+                 a blue noise mask (georgiev and fajardo, "blue-noise dithered sampling",
+                 2016), so what error is left is spread evenly instead of clumping
+
+Every type is seeded by (frame, pixel, sample) like pcg32::for_sample, so a sample's numbers
+don't depend on which thread takes it or when.
+*/
+enum class sampler_type : uint32_t { independent, stratified, sobol, blue_noise };
+
+// a point of the unit square
+struct sample_2d {
+    double u, v;
+};
+
+namespace sampler_detail {
+
+// lowbias32 (wellons): a 32 bit integer hash with good avalanche
+inline uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t hash_combine(uint32_t seed, uint32_t v) {
+    return hash(seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+inline uint32_t reverse_bits(uint32_t x) {
+    x = std::byteswap(x);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+// a hash in which each bit only depends on the bits below it: on bit-reversed values, an
+// owen scramble (every subinterval's halves swapped or not at random)
+inline uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+    return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+// the first two dimensions of the sobol sequence, bit reversed (so ready to owen scramble).
+// the first is van der corput's, whose reversal is the index itself. the second's direction
+// numbers come from the polynomial x + 1, and its point is the xor of those for the index's
+// set bits, looked up here a byte at a time: a shuffled index (see scrambled_sobol) has all
+// 32 bits in use, too many to loop over one by one.
+struct sobol_1_table {
+    uint32_t bytes[4][256];
+
+    constexpr sobol_1_table() : bytes{} {
+        uint32_t direction[32] = {};
+        direction[0] = 1; // 1 << 31, reversed
+        for (int k = 1; k < 32; k++)
+            direction[k] = direction[k - 1] ^ (direction[k - 1] << 1);
+        for (int b = 0; b < 4; b++)
+            for (int value = 0; value < 256; value++)
+                for (int bit = 0; bit < 8; bit++)
+                    if (value & (1 << bit))
+                        bytes[b][value] ^= direction[8 * b + bit];
+    }
+};
+
+inline constexpr sobol_1_table sobol_1_bytes;
+
+inline uint32_t reversed_sobol_1(uint32_t i) {
+    const auto& t = sobol_1_bytes.bytes;
+    return t[0][i & 0xff] ^ t[1][(i >> 8) & 0xff] ^ t[2][(i >> 16) & 0xff] ^ t[3][i >> 24];
+}
+
+// scrambled sobol point number index, with the order shuffled too
+inline sample_2d scrambled_sobol(uint32_t index, uint32_t seed) {
+    index = nested_uniform_scramble(index, seed);
+    uint32_t x = reverse_bits(laine_karras_permutation(index, seed * 0x9e3779b9u));
+    uint32_t y = reverse_bits(laine_karras_permutation(reversed_sobol_1(index), hash(seed)));
+    return { x * 0x1p-32, y * 0x1p-32 };
+}
+
+// element i of a random permutation of [0, n) picked by seed, without building it (kensler,
+// "correlated multi-jittered sampling", 2013). cycle walks over the next power of two.
+inline uint32_t permute(uint32_t i, uint32_t n, uint32_t seed) {
+    uint32_t w = n - 1;
+    w |= w >> 1; w |= w >> 2; w |= w >> 4; w |= w >> 8; w |= w >> 16;
+    do {
+        i ^= seed;           i *= 0xe170893du;
+        i ^= seed >> 16;     i ^= (i & w) >> 4;
+        i ^= seed >> 8;      i *= 0x0929eb3fu;
+        i ^= seed >> 23;     i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27; i *= 0x6935fa69u;
+        i ^= (i & w) >> 11;  i *= 0x74dcb303u;
+        i ^= (i & w) >> 2;   i *= 0x9e501cc3u;
+        i ^= (i & w) >> 2;   i *= 0xc860a3dfu;
+        i &= w;              i ^= i >> 5;
+    } while (i >= n);
+    return (i + seed) % n;
+}
+
+constexpr int mask_size = 64; // blue noise tile width and height
+
+/*
+A tile of blue noise: every value 0 .. mask_size^2 - 1 once, arranged so that thresholding
+it anywhere leaves evenly spread points with no clumps or holes. Made with ulichney's void
+and cluster method: points go one at a time into the emptiest spot (lowest energy under a
+gaussian splatted around every point, on the torus so the tile wraps), and take their rank
+from the order they went in.
+*/
+inline std::vector<uint16_t> make_blue_noise() {
+    constexpr int size = mask_size, n = size * size;
+    const double sigma = 1.5;
+
+    std::vector<float> kernel(n);
+    for (int dy = 0; dy < size; dy++) {
+        for (int dx = 0; dx < size; dx++) {
+            int x = std::min(dx, size - dx), y = std::min(dy, size - dy);
+            kernel[dy * size + dx] = float(std::exp(-(x * x + y * y) / (2 * sigma * sigma)));
+        }
+    }
+
+    std::vector<uint8_t> on(n, 0);
+    std::vector<float> energy(n, 0);
+    auto splat = [&](int p, float sign) {
+        on[p] = sign > 0;
+        int px = p % size, py = p / size;
+        for (int y = 0; y < size; y++) {
+            const float* row = &kernel[((y - py + size) % size) * size];
+            for (int x = 0; x < size; x++)
+                energy[y * size + x] += sign * row[(x - px + size) % size];
+        }
+    };
+    // the point in the tightest cluster, or the spot at the centre of the largest void
+    auto extreme = [&](bool cluster) {
+        int best = -1;
+        for (int p = 0; p < n; p++)
+            if (on[p] == cluster && (best < 0 || (cluster ? energy[p] > energy[best] : energy[p] < energy[best])))
+                best = p;
+        return best;
+    };
+
+    // a tenth of the points at random, then relaxed by moving the most crowded point to the
+    // largest void until that would put it straight back
+    pcg32 rng(1, 0);
+    const int initial = n / 10;
+    for (int placed = 0; placed < initial;) {
+        int p = int(rng.next_uint() % n);
+        if (!on[p]) {
+            splat(p, 1);
+            placed++;
+        }
+    }
+    while (true) {
+        int crowded = extreme(true);
+        splat(crowded, -1);
+        int empty = extreme(false);
+        splat(empty, 1);
+        if (empty == crowded)
+            break;
+    }
+
+    std::vector<uint16_t> rank(n);
+    std::vector<uint8_t> initial_on = on;
+    std::vector<float> initial_energy = energy;
+
+    // the initial points rank below it, most crowded last in
+    for (int r = initial - 1; r >= 0; r--) {
+        int p = extreme(true);
+        rank[p] = uint16_t(r);
+        splat(p, -1);
+    }
+
+    // and the rest above it, filling the largest void each time
+    on = std::move(initial_on);
+    energy = std::move(initial_energy);
+    for (int r = initial; r < n; r++) {
+        int p = extreme(false);
+        rank[p] = uint16_t(r);
+        splat(p, 1);
+    }
+    return rank;
+}
+
+// the mask's value at (x, y), wrapped, in [0, 1)
+inline double blue_noise(int x, int y) {
+    static const std::vector<uint16_t> mask = make_blue_noise();
+    int k = (y & (mask_size - 1)) * mask_size + (x & (mask_size - 1));
+    return (mask[k] + 0.5) / (mask_size * mask_size);
+}
+
+} // namespace sampler_detail
+
+class sampler {
+  public:
+    sampler() = default;
+
+    // sample number index (of count for the pixel) of pixel i, j in an image width wide
+    sampler(sampler_type type, uint64_t frame, int i, int j, int width, int index, int count)
+        : rng(pcg32::for_sample(frame, uint64_t(j) * width + i, index)), type(type),
+          index(uint32_t(index)), count(uint32_t(count)), x(i), y(j) {
+        using namespace sampler_detail;
+        frame_seed = hash(uint32_t(frame) ^ hash(uint32_t(frame >> 32)));
+        pixel_seed = hash_combine(frame_seed, uint32_t(uint64_t(j) * width + i));
+    }
+
+    double get_1d() {
+        using namespace sampler_detail;
+        uint32_t d = dimension++;
+        switch (type) {
+            case sampler_type::stratified:
+                if (index >= count)
+                    break;
+                return (permute(index, count, hash_combine(pixel_seed, d)) + rng.next_double()) / count;
+            case sampler_type::sobol:
+                return scrambled_sobol(index, hash_combine(pixel_seed, d)).u;
+            case sampler_type::blue_noise:
+                return shift(scrambled_sobol(index, hash_combine(frame_seed, d)).u, d, 0);
+            default:
+                break;
+        }
+        return rng.next_double();
+    }
+
+    sample_2d get_2d() {
+        using namespace sampler_detail;
+        uint32_t d = dimension++;
+        switch (type) {
+            case sampler_type::stratified: {
+                uint32_t side = uint32_t(std::sqrt(double(count)));
+                if (index >= side * side)
+                    break;
+                uint32_t cell = permute(index, side * side, hash_combine(pixel_seed, d));
+                double u = (cell % side + rng.next_double()) / side;
+                double v = (cell / side + rng.next_double()) / side;
+                return { u, v };
+            }
+            case sampler_type::sobol:
+                return scrambled_sobol(index, hash_combine(pixel_seed, d));
+            case sampler_type::blue_noise: {
+                sample_2d s = scrambled_sobol(index, hash_combine(frame_seed, d));
+                return { shift(s.u, d, 0), shift(s.v, d, 1) };
+            }
+            default:
+                break;
+        }
+        double u = rng.next_double();
+        return { u, rng.next_double() };
+    }
+
+  private:
+    pcg32 rng;
+    sampler_type type = sampler_type::independent;
+    uint32_t index = 0, count = 1;
+    int32_t x = 0, y = 0;
+    uint32_t frame_seed = 0, pixel_seed = 0;
+    uint32_t dimension = 0; // next dimension to hand out
+
+    // value moved round the unit interval by the pixel's blue noise, read from the tile at an
+    // offset that differs with the dimension and axis so they don't share it
+    double shift(double value, uint32_t d, uint32_t axis) const {
+        using namespace sampler_detail;
+        uint32_t offset = hash_combine(frame_seed, 2 * d + axis);
+        double shifted = value + blue_noise(x + int(offset & 0xffff), y + int(offset >> 16));
+        return shifted < 1 ? shifted : shifted - 1;
+    }
+};
+
+#endif
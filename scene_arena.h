@@ -0,0 +1,136 @@
+#ifndef SCENE_ARENA_H
+#define SCENE_ARENA_H
+
+#include "material.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+Pool allocator for scene objects. Each type gets its own pool of chunks, so objects of one
+type sit next to each other in the order they were made instead of wherever the heap put
+them, and there is no per-object allocation header. Objects live until the arena is
+destroyed and never move, so plain pointers to them stay valid even if the arena does.
+
+Materials made through make_material are interned by value: every sphere with the same
+parameters points at the same material.
+*/
+class scene_arena {
+  public:
+    scene_arena() = default;
+    scene_arena(scene_arena&&) = default;
+    scene_arena& operator=(scene_arena&&) = default;
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return pool_for<T>().emplace(std::forward<Args>(args)...);
+    }
+
+    const material* make_material(const material_desc& m) {
+        auto found = materials.find(m);
+        if (found != materials.end())
+            return found->second;
+
+        const material* made;
+        switch (m.type) {
+            case material_desc::kind::metal:      made = make<metal>(m.albedo, m.fuzz); break;
+            case material_desc::kind::dielectric: made = make<dielectric>(m.refraction_index); break;
+            case material_desc::kind::emissive:   made = make<diffuse_light>(m.albedo); break;
+            default:                              made = make<lambertian>(m.albedo); break;
+        }
+        materials.emplace(m, made);
+        return made;
+    }
+
+    size_t material_count() const { return materials.size(); }
+
+    // bytes held in chunks, used or not
+    size_t bytes_reserved() const {
+        size_t total = 0;
+        for (const auto& p : pools)
+            total += p.pool->bytes_reserved();
+        return total;
+    }
+
+  private:
+    struct pool_base {
+        virtual ~pool_base() = default;
+        virtual size_t bytes_reserved() const = 0;
+    };
+
+    template <typename T>
+    class pool : public pool_base {
+      public:
+        pool() = default;
+        pool(const pool&) = delete;
+        pool& operator=(const pool&) = delete;
+
+        ~pool() override {
+            for (auto& c : chunks) {
+                for (size_t i = 0; i < c.used; i++)
+                    c.data[i].~T();
+                ::operator delete(c.data, std::align_val_t(alignof(T)));
+            }
+        }
+
+        template <typename... Args>
+        T* emplace(Args&&... args) {
+            if (chunks.empty() || chunks.back().used == chunks.back().capacity) {
+                // chunks double in size, so a few spheres don't reserve much and a million
+                // take about a dozen allocations
+                size_t capacity = chunks.empty() ? first_chunk : std::min(2 * chunks.back().capacity, max_chunk);
+                void* data = ::operator new(capacity * sizeof(T), std::align_val_t(alignof(T)));
+                chunks.push_back({ static_cast<T*>(data), 0, capacity });
+            }
+            chunk& c = chunks.back();
+            T* object = new (c.data + c.used) T(std::forward<Args>(args)...);
+            c.used++;
+            return object;
+        }
+
+        size_t bytes_reserved() const override {
+            size_t total = 0;
+            for (const auto& c : chunks)
+                total += c.capacity * sizeof(T);
+            return total;
+        }
+
+      private:
+        static constexpr size_t first_chunk = 64;
+        static constexpr size_t max_chunk = 65536;
+
+        struct chunk {
+            T*     data;
+            size_t used;
+            size_t capacity;
+        };
+        std::vector<chunk> chunks;
+    };
+
+    struct pool_entry {
+        std::type_index type;
+        std::unique_ptr<pool_base> pool;
+    };
+
+    // a scene only has a handful of types, so a linear search beats a map
+    template <typename T>
+    pool<T>& pool_for() {
+        std::type_index type(typeid(T));
+        for (auto& p : pools)
+            if (p.type == type)
+                return static_cast<pool<T>&>(*p.pool);
+        pools.push_back({ type, std::make_unique<pool<T>>() });
+        return static_cast<pool<T>&>(*pools.back().pool);
+    }
+
+    std::vector<pool_entry> pools;
+    std::unordered_map<material_desc, const material*, material_desc_hash> materials;
+};
+
+#endif
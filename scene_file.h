@@ -0,0 +1,704 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "animation.h"
+#include "camera.h"
+#include "material.h"
+#include "bvh.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "mesh.h"
+#include "obj_file.h"
+#include "sphere_soup.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+Scene files, so scenes can change without a recompile. Two forms:
+
+Text, for writing by hand. One statement per line, '#' starts a comment:
+    image_width 1200            (also aspect_ratio, samples_per_pixel, max_depth, vfov,
+    lookfrom 13 2 3              defocus_angle, focus_distance, lookat, vup)
+    material glass dielectric 1.5
+    material steel metal 0.7 0.6 0.5 0.0        (albedo r g b, fuzz)
+    material ground lambertian 0.5 0.5 0.5
+    material lamp emissive 4 4 4                (radiance r g b; emissive spheres are lights)
+    sphere 0 -1000 0 1000 ground                (centre x y z, radius, material name)
+    sphere 4 1 0 1 metal 0.7 0.6 0.5 0.0        (or a material given inline)
+    background black                            (or sky, the default)
+    key 0  13 2 3  0 0 0  20 10                 (camera key for animations: frame, lookfrom,
+                                                 lookat, vfov, focus_distance)
+    mesh bunny.obj steel                        (an obj file, relative to the scene file,
+                                                 with a material name or one given inline)
+    mesh bunny.obj steel scale 2 2 2 rotate 0 1 0 90 translate 3 0 0
+                                                (placed by transforms applied in order; also
+                                                 matrix, the 3x4 rows of an affine transform;
+                                                 meshes can't be emissive)
+
+Binary, for big scenes: a fixed header, the materials, the spheres as structure-of-arrays
+in bvh leaf order and the bvh nodes themselves. Loading maps the file and copies each array
+once, with no parsing, per-sphere allocation or bvh build. The layout is the native one of
+the machine that wrote it (see binary_header). Camera keys and meshes are only kept in the
+text form.
+
+Either way, materials with identical parameters are stored once and shared by index.
+*/
+
+/*
+Everything a scene file holds: camera settings, deduplicated materials and the spheres
+as structure-of-arrays.
+*/
+struct scene_desc {
+    camera cam; // settings the file doesn't give keep the camera class defaults
+    camera_path path; // camera keys, if the scene is animated
+
+    // obj meshes, as the file places them. load_scene reads each file once into
+    // mesh_geometry, and meshes placed more than once or transformed become instances of it.
+    struct mesh_ref {
+        std::string path;
+        int material;
+        affine transform;
+        bool transformed = false;
+        int geometry = -1; // into mesh_geometry
+    };
+    std::vector<mesh_ref> meshes;
+    std::vector<std::unique_ptr<triangle_mesh>> mesh_geometry;
+
+    std::vector<material_desc> materials;
+    std::vector<double> cx, cy, cz, radius;
+    std::vector<int32_t> material_id;
+    std::vector<bvh_node> nodes; // prebuilt bvh (binary files only), spheres in its leaf order
+
+    size_t size() const { return radius.size(); }
+
+    // returns the index of an identical material if there already is one
+    int add_material(const material_desc& m) {
+        auto found = material_index.find(m);
+        if (found != material_index.end())
+            return found->second;
+        materials.push_back(m);
+        int id = int(materials.size()) - 1;
+        material_index.emplace(m, id);
+        return id;
+    }
+
+    void add_sphere(const point3& center, double r, int material) {
+        cx.push_back(center.x());
+        cy.push_back(center.y());
+        cz.push_back(center.z());
+        radius.push_back(r);
+        material_id.push_back(material);
+        nodes.clear();
+    }
+
+    // sorts the spheres into bvh leaf order and keeps the tree, so it can be saved with them
+    void build_bvh() {
+        sphere_soup soup;
+        soup.assign(cx, cy, cz, radius, material_id);
+        auto order = soup.build();
+        permute(cx, order);
+        permute(cy, order);
+        permute(cz, order);
+        permute(radius, order);
+        permute(material_id, order);
+        nodes = soup.tree_nodes();
+    }
+
+    // hands the spheres over to a sphere soup (leaving this scene without them), using the
+    // stored bvh if there is one. a few dozen spheres are left flat, see main.cpp.
+    std::unique_ptr<sphere_soup> take_world() {
+        auto soup = std::make_unique<sphere_soup>();
+        for (const auto& m : materials)
+            soup->add_material(m.make());
+
+        size_t count = size();
+        soup->assign(std::move(cx), std::move(cy), std::move(cz), std::move(radius), std::move(material_id));
+        if (!nodes.empty())
+            soup->use_tree(nodes.data(), nodes.size());
+        else if (count > 64)
+            soup->build();
+        return soup;
+    }
+
+    // the emissive spheres, for the camera to sample (camera::lights)
+    light_list lights() const {
+        light_list list;
+        for (size_t i = 0; i < size(); i++) {
+            const material_desc& m = materials[material_id[i]];
+            if (m.type == material_desc::kind::emissive)
+                list.add_sphere(point3(cx[i], cy[i], cz[i]), radius[i], m.albedo);
+        }
+        list.build();
+        return list;
+    }
+
+    // take_world's spheres with the meshes alongside them, under a bvh. without meshes
+    // that's just the soup.
+    std::unique_ptr<hittable> take_scene() {
+        if (meshes.empty())
+            return take_world();
+
+        std::vector<int> uses(mesh_geometry.size(), 0);
+        for (const auto& m : meshes)
+            uses[m.geometry]++;
+
+        hittable_list list;
+        std::vector<const hittable*> shared(mesh_geometry.size(), nullptr);
+        for (const auto& m : meshes) {
+            const material* mat = list.make_material(materials[m.material]);
+            auto& geometry = mesh_geometry[m.geometry];
+            if (uses[m.geometry] == 1 && !m.transformed) {
+                geometry->set_material(mat);
+                list.add(std::move(geometry));
+                continue;
+            }
+            if (!shared[m.geometry])
+                shared[m.geometry] = list.keep(std::move(geometry));
+            list.emplace<instance>(shared[m.geometry], m.transform, mat);
+        }
+        meshes.clear();
+        mesh_geometry.clear();
+
+        if (size() > 0)
+            list.add(take_world());
+        return std::make_unique<bvh>(std::move(list));
+    }
+
+  private:
+    std::unordered_map<material_desc, int, material_desc_hash> material_index;
+
+    template <typename T>
+    static void permute(std::vector<T>& v, const std::vector<int>& order) {
+        std::vector<T> sorted(v.size());
+        for (size_t i = 0; i < order.size(); i++)
+            sorted[i] = v[order[i]];
+        v = std::move(sorted);
+    }
+};
+
+namespace scene_file_detail {
+
+constexpr char binary_magic[8] = { 'R', 'T', 'S', 'C', 'N', 'B', '1', '\n' };
+
+// fixed part of a binary scene, directly after the magic. the struct sizes are recorded so a
+// file from a different build (or machine) is rejected rather than misread.
+struct binary_header {
+    uint32_t header_size;
+    uint32_t node_size;
+    uint64_t material_count;
+    uint64_t sphere_count;
+    uint64_t node_count;
+
+    double   aspect_ratio, vfov, defocus_angle, focus_distance;
+    double   lookfrom[3], lookat[3], vup[3];
+    int32_t  image_width, samples_per_pixel, max_depth, black_background;
+};
+
+struct binary_material {
+    uint32_t type;
+    uint32_t pad;
+    double   albedo[3];
+    double   fuzz;
+    double   refraction_index;
+};
+
+// splits a line into whitespace separated tokens without allocating
+class tokenizer {
+  public:
+    explicit tokenizer(std::string_view line) : rest(line) {}
+
+    bool next(std::string_view& token) {
+        size_t start = rest.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos)
+            return false;
+        size_t end = rest.find_first_of(" \t\r", start);
+        if (end == std::string_view::npos)
+            end = rest.size();
+        token = rest.substr(start, end - start);
+        rest.remove_prefix(end);
+        return true;
+    }
+
+    bool number(double& value) {
+        std::string_view token;
+        if (!next(token))
+            return false;
+        auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+        return result.ec == std::errc() && result.ptr == token.data() + token.size();
+    }
+
+    bool number(int& value) {
+        double d;
+        // range first: converting a double that int can't hold is undefined
+        if (!number(d) || !(d >= std::numeric_limits<int>::min() && d <= std::numeric_limits<int>::max())
+            || d != double(int(d)))
+            return false;
+        value = int(d);
+        return true;
+    }
+
+    bool vector(vec3& v) {
+        double x, y, z;
+        if (!number(x) || !number(y) || !number(z))
+            return false;
+        v = vec3(x, y, z);
+        return true;
+    }
+
+    bool done() {
+        std::string_view token;
+        return !next(token);
+    }
+
+  private:
+    std::string_view rest;
+};
+
+// parses "lambertian r g b" / "metal r g b fuzz" / "dielectric ri" / "emissive r g b" with
+// the kind already read
+inline bool parse_material(std::string_view kind, tokenizer& tokens, material_desc& m) {
+    if (kind == "lambertian") {
+        m.type = material_desc::kind::lambertian;
+        return tokens.vector(m.albedo);
+    }
+    if (kind == "metal") {
+        m.type = material_desc::kind::metal;
+        return tokens.vector(m.albedo) && tokens.number(m.fuzz);
+    }
+    if (kind == "dielectric") {
+        m.type = material_desc::kind::dielectric;
+        return tokens.number(m.refraction_index);
+    }
+    if (kind == "emissive") {
+        m.type = material_desc::kind::emissive;
+        return tokens.vector(m.albedo);
+    }
+    return false;
+}
+
+inline bool parse_text(std::string_view text, scene_desc& scene, std::string& error) {
+    std::unordered_map<std::string, int> named;
+    int line_number = 0;
+
+    // a material name, or a material given inline
+    auto material_ref = [&](tokenizer& tokens, int& id) {
+        std::string_view mat;
+        if (!tokens.next(mat))
+            return false;
+        auto found = named.find(std::string(mat));
+        if (found != named.end()) {
+            id = found->second;
+            return true;
+        }
+        material_desc m;
+        if (!parse_material(mat, tokens, m))
+            return false;
+        id = scene.add_material(m);
+        return true;
+    };
+
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        line_number++;
+
+        size_t comment = line.find('#');
+        if (comment != std::string_view::npos)
+            line = line.substr(0, comment);
+
+        tokenizer tokens(line);
+        std::string_view key;
+        if (!tokens.next(key))
+            continue;
+
+        camera& cam = scene.cam;
+        bool ok;
+        if (key == "sphere") {
+            vec3 center;
+            double r;
+            int id;
+            ok = tokens.vector(center) && tokens.number(r) && material_ref(tokens, id);
+            if (ok)
+                scene.add_sphere(center, r, id);
+        } else if (key == "material") {
+            std::string_view name, kind;
+            material_desc m;
+            ok = tokens.next(name) && tokens.next(kind) && parse_material(kind, tokens, m);
+            if (ok)
+                named[std::string(name)] = scene.add_material(m);
+        }
+        else if (key == "mesh") {
+            scene_desc::mesh_ref m;
+            std::string_view file, op;
+            ok = tokens.next(file) && material_ref(tokens, m.material);
+            while (ok && tokens.next(op)) {
+                vec3 v;
+                double angle;
+                affine step;
+                if (op == "translate" && tokens.vector(v))
+                    step = affine::translate(v);
+                else if (op == "scale" && tokens.vector(v))
+                    step = affine::scale(v);
+                else if (op == "rotate" && tokens.vector(v) && tokens.number(angle))
+                    step = affine::rotate(v, angle);
+                else if (op == "matrix") {
+                    for (int r = 0; r < 3 && ok; r++) {
+                        for (int c = 0; c < 4 && ok; c++) {
+                            double x;
+                            ok = tokens.number(x);
+                            step.m[r][c] = x;
+                        }
+                    }
+                } else {
+                    ok = false;
+                }
+                m.transform = step * m.transform;
+                m.transformed = true;
+            }
+            m.path = file;
+            // light_list has no triangles to sample, and an emitter it doesn't sample would be
+            // weighted as though it did
+            ok = ok && scene.materials[m.material].type != material_desc::kind::emissive;
+            if (ok)
+                scene.meshes.push_back(std::move(m));
+        }
+        else if (key == "key") {
+            camera_key k;
+            ok = tokens.number(k.frame) && tokens.vector(k.lookfrom) && tokens.vector(k.lookat)
+                 && tokens.number(k.vfov) && tokens.number(k.focus_distance);
+            if (ok)
+                scene.path.add(k);
+        }
+        else if (key == "background") {
+            std::string_view name;
+            ok = tokens.next(name) && (name == "sky" || name == "black");
+            cam.sky_light = name == "sky";
+        }
+        else if (key == "image_width")       ok = tokens.number(cam.image_width) && cam.image_width > 0;
+        else if (key == "aspect_ratio")      ok = tokens.number(cam.aspect_ratio);
+        else if (key == "samples_per_pixel") ok = tokens.number(cam.samples_per_pixel) && cam.samples_per_pixel > 0;
+        else if (key == "max_depth")         ok = tokens.number(cam.max_depth) && cam.max_depth > 0;
+        else if (key == "vfov")              ok = tokens.number(cam.vfov);
+        else if (key == "defocus_angle")     ok = tokens.number(cam.defocus_angle);
+        else if (key == "focus_distance")    ok = tokens.number(cam.focus_distance);
+        else if (key == "lookfrom")          ok = tokens.vector(cam.lookfrom);
+        else if (key == "lookat")            ok = tokens.vector(cam.lookat);
+        else if (key == "vup")               ok = tokens.vector(cam.vup);
+        else ok = false;
+
+        if (!ok || !tokens.done()) {
+            error = "line " + std::to_string(line_number) + ": can't parse '" + std::string(line) + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+// read-only mapping of a whole file, unmapped when it goes out of scope
+class mapped_file {
+  public:
+    explicit mapped_file(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                bytes = static_cast<const char*>(p);
+                length = size_t(st.st_size);
+            }
+        }
+        ::close(fd);
+    }
+
+    ~mapped_file() {
+        if (bytes)
+            ::munmap(const_cast<char*>(bytes), length);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+  private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+};
+
+template <typename T>
+bool read_array(const char*& p, const char* end, std::vector<T>& out, size_t count) {
+    // counts come from the file, so checked against what's left before they're multiplied
+    if (count > size_t(end - p) / sizeof(T))
+        return false;
+    size_t bytes = count * sizeof(T);
+    out.resize(count);
+    std::memcpy(out.data(), p, bytes);
+    p += bytes;
+    return true;
+}
+
+inline bool parse_binary(const char* data, size_t size, scene_desc& scene, std::string& error) {
+    const char* p = data + sizeof(binary_magic);
+    const char* end = data + size;
+
+    binary_header h;
+    if (size_t(end - p) < sizeof(h)) {
+        error = "truncated header";
+        return false;
+    }
+    std::memcpy(&h, p, sizeof(h));
+    p += sizeof(h);
+    if (h.header_size != sizeof(binary_header) || h.node_size != sizeof(bvh_node)) {
+        error = "written by an incompatible build, regenerate it from the text scene";
+        return false;
+    }
+
+    camera& cam = scene.cam;
+    cam.aspect_ratio = h.aspect_ratio;
+    cam.vfov = h.vfov;
+    cam.defocus_angle = h.defocus_angle;
+    cam.focus_distance = h.focus_distance;
+    cam.lookfrom = point3(h.lookfrom[0], h.lookfrom[1], h.lookfrom[2]);
+    cam.lookat = point3(h.lookat[0], h.lookat[1], h.lookat[2]);
+    cam.vup = vec3(h.vup[0], h.vup[1], h.vup[2]);
+    cam.image_width = h.image_width;
+    cam.samples_per_pixel = h.samples_per_pixel;
+    cam.max_depth = h.max_depth;
+    cam.sky_light = !h.black_background;
+    if (cam.image_width <= 0 || cam.samples_per_pixel <= 0 || cam.max_depth <= 0) {
+        error = "image_width, samples_per_pixel and max_depth must be positive";
+        return false;
+    }
+
+    std::vector<binary_material> materials;
+    bool ok = read_array(p, end, materials, h.material_count)
+           && read_array(p, end, scene.cx, h.sphere_count)
+           && read_array(p, end, scene.cy, h.sphere_count)
+           && read_array(p, end, scene.cz, h.sphere_count)
+           && read_array(p, end, scene.radius, h.sphere_count)
+           && read_array(p, end, scene.material_id, h.sphere_count);
+    // the node array starts on an 8 byte boundary
+    p = data + ((p - data + 7) & ~size_t(7));
+    ok = ok && p <= end && read_array(p, end, scene.nodes, h.node_count);
+    if (!ok) {
+        error = "truncated file";
+        return false;
+    }
+
+    if (!bvh_tree::valid(scene.nodes, h.sphere_count)) {
+        error = "corrupt bvh";
+        return false;
+    }
+
+    scene.materials.clear();
+    for (const auto& bm : materials) {
+        if (bm.type > uint32_t(material_kind::emissive)) {
+            error = "material of unknown type " + std::to_string(bm.type);
+            return false;
+        }
+        material_desc m;
+        m.type = material_desc::kind(bm.type);
+        m.albedo = colour(bm.albedo[0], bm.albedo[1], bm.albedo[2]);
+        m.fuzz = bm.fuzz;
+        m.refraction_index = bm.refraction_index;
+        scene.materials.push_back(m);
+    }
+    for (int32_t id : scene.material_id) {
+        if (id < 0 || size_t(id) >= scene.materials.size()) {
+            error = "sphere with an unknown material";
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+void write_array(std::ostream& out, const std::vector<T>& v) {
+    out.write(reinterpret_cast<const char*>(v.data()), std::streamsize(v.size() * sizeof(T)));
+}
+
+} // namespace scene_file_detail
+
+// loads a text or binary scene file, telling them apart by the binary magic
+inline bool load_scene(const std::string& path, scene_desc& scene, std::string& error) {
+    using namespace scene_file_detail;
+
+    mapped_file file(path);
+    if (!file.data()) {
+        error = "can't read " + path;
+        return false;
+    }
+
+    bool ok;
+    if (file.size() >= sizeof(binary_magic) && std::memcmp(file.data(), binary_magic, sizeof(binary_magic)) == 0)
+        ok = parse_binary(file.data(), file.size(), scene, error);
+    else
+        ok = parse_text(std::string_view(file.data(), file.size()), scene, error);
+
+    if (!ok) {
+        error = path + ": " + error;
+        return false;
+    }
+
+    std::unordered_map<std::string, int> loaded;
+    for (auto& m : scene.meshes) {
+        auto found = loaded.find(m.path);
+        if (found != loaded.end()) {
+            m.geometry = found->second;
+            continue;
+        }
+        std::filesystem::path file = m.path;
+        if (file.is_relative())
+            file = std::filesystem::path(path).parent_path() / file;
+        auto mesh = std::make_unique<triangle_mesh>();
+        if (!load_obj(file.string(), *mesh, error))
+            return false;
+        mesh->build();
+        m.geometry = int(scene.mesh_geometry.size());
+        loaded.emplace(m.path, m.geometry);
+        scene.mesh_geometry.push_back(std::move(mesh));
+    }
+    return true;
+}
+
+// writes the binary form, building the bvh first if the scene doesn't have one yet. the
+// binary form only holds spheres, materials and a still camera: a scene with meshes or camera
+// keys is refused rather than written without them
+inline bool save_binary_scene(const std::string& path, scene_desc& scene, std::string& error) {
+    using namespace scene_file_detail;
+
+    if (!scene.meshes.empty() || !scene.path.empty()) {
+        error = "can't write " + path + ": the binary form doesn't hold meshes or camera keys";
+        return false;
+    }
+
+    if (scene.nodes.empty() && scene.size() > 0)
+        scene.build_bvh();
+
+    const camera& cam = scene.cam;
+    binary_header h = {};
+    h.header_size = sizeof(binary_header);
+    h.node_size = sizeof(bvh_node);
+    h.material_count = scene.materials.size();
+    h.sphere_count = scene.size();
+    h.node_count = scene.nodes.size();
+    h.aspect_ratio = cam.aspect_ratio;
+    h.vfov = cam.vfov;
+    h.defocus_angle = cam.defocus_angle;
+    h.focus_distance = cam.focus_distance;
+    for (int k = 0; k < 3; k++) {
+        h.lookfrom[k] = cam.lookfrom[k];
+        h.lookat[k] = cam.lookat[k];
+        h.vup[k] = cam.vup[k];
+    }
+    h.image_width = cam.image_width;
+    h.samples_per_pixel = cam.samples_per_pixel;
+    h.max_depth = cam.max_depth;
+    h.black_background = !cam.sky_light;
+
+    std::vector<binary_material> materials;
+    for (const auto& m : scene.materials) {
+        binary_material bm = {};
+        bm.type = uint32_t(m.type);
+        for (int k = 0; k < 3; k++)
+            bm.albedo[k] = m.albedo[k];
+        bm.fuzz = m.fuzz;
+        bm.refraction_index = m.refraction_index;
+        materials.push_back(bm);
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        error = "could not write " + path;
+        return false;
+    }
+
+    out.write(binary_magic, sizeof(binary_magic));
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    write_array(out, materials);
+    write_array(out, scene.cx);
+    write_array(out, scene.cy);
+    write_array(out, scene.cz);
+    write_array(out, scene.radius);
+    write_array(out, scene.material_id);
+    static const char padding[8] = {};
+    out.write(padding, std::streamsize((8 - out.tellp() % 8) % 8));
+    write_array(out, scene.nodes);
+    if (!out) {
+        error = "could not write " + path;
+        return false;
+    }
+    return true;
+}
+
+// writes the text form, every sphere with its material inline
+inline bool save_text_scene(const std::string& path, const scene_desc& scene) {
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    const camera& cam = scene.cam;
+    out.precision(17);
+    out << "image_width " << cam.image_width << "\naspect_ratio " << cam.aspect_ratio
+        << "\nsamples_per_pixel " << cam.samples_per_pixel << "\nmax_depth " << cam.max_depth
+        << "\nvfov " << cam.vfov << "\nlookfrom " << cam.lookfrom << "\nlookat " << cam.lookat
+        << "\nvup " << cam.vup << "\ndefocus_angle " << cam.defocus_angle
+        << "\nfocus_distance " << cam.focus_distance << '\n';
+    if (!cam.sky_light)
+        out << "background black\n";
+    out << '\n';
+
+    for (const camera_key& k : scene.path.all())
+        out << "key " << k.frame << "  " << k.lookfrom << "  " << k.lookat << "  " << k.vfov << ' ' << k.focus_distance << '\n';
+    if (!scene.path.empty())
+        out << '\n';
+
+    for (size_t m = 0; m < scene.materials.size(); m++) {
+        const material_desc& d = scene.materials[m];
+        out << "material m" << m << ' ';
+        switch (d.type) {
+            case material_desc::kind::metal:      out << "metal " << d.albedo << ' ' << d.fuzz; break;
+            case material_desc::kind::dielectric: out << "dielectric " << d.refraction_index; break;
+            case material_desc::kind::emissive:   out << "emissive " << d.albedo; break;
+            default:                              out << "lambertian " << d.albedo; break;
+        }
+        out << '\n';
+    }
+
+    for (size_t i = 0; i < scene.size(); i++) {
+        out << "sphere " << scene.cx[i] << ' ' << scene.cy[i] << ' ' << scene.cz[i] << ' '
+            << scene.radius[i] << " m" << scene.material_id[i] << '\n';
+    }
+    for (const auto& m : scene.meshes) {
+        out << "mesh " << m.path << " m" << m.material;
+        if (m.transformed) {
+            out << " matrix";
+            for (const auto& row : m.transform.m)
+                for (real x : row)
+                    out << ' ' << x;
+        }
+        out << '\n';
+    }
+    return bool(out);
+}
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "camera.h"
+#include "material.h"
+
+/*
+Scenes shared by the renderer and the benchmarks.
+Scenes are built through an add_sphere(center, radius, material_desc) callback so the same
+scene can fill a hittable_list, a sphere_soup or anything else that holds spheres.
+*/
+
+// the cover scene from the book, with a 6x6 grid of small random spheres.
+// uses its own fixed rng so every call builds exactly the same scene.
+template <typename AddSphere>
+void book_scene(AddSphere&& add_sphere) {
+    pcg32 rng;
+
+    // ground
+    add_sphere(
+        point3(0, -1000, 0), 1000,
+        material_desc::make_lambertian(colour(0.5, 0.5, 0.5))
+    );
+
+    // random small spheres
+    for (int a = -3; a < 3; a++) {
+        for (int b = -3; b < 3; b++) {
+            auto choose_mat = random_double(rng);
+            point3 center(a + 0.9 * random_double(rng), 0.2, b + 0.9 * random_double(rng));
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = colour::random(rng) * colour::random(rng);
+                    add_sphere(
+                        center, 0.2,
+                        material_desc::make_lambertian(albedo)
+                    );
+                } else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = colour::random(rng, 0.5, 1);
+                    auto fuzz   = random_double(rng, 0, 0.5);
+                    add_sphere(
+                        center, 0.2,
+                        material_desc::make_metal(albedo, fuzz)
+                    );
+                } else {
+                    // glass
+                    add_sphere(
+                        center, 0.2,
+                        material_desc::make_dielectric(1.5)
+                    );
+                }
+            }
+        }
+    }
+
+    add_sphere(
+        point3(0, 1, 0), 1.0,
+        material_desc::make_dielectric(1.5)
+    );
+
+    add_sphere(
+        point3(-4, 1, 0), 1.0,
+        material_desc::make_lambertian(colour(0.4, 0.2, 0.1))
+    );
+
+    add_sphere(
+        point3(4, 1, 0), 1.0,
+        material_desc::make_metal(colour(0.7, 0.6, 0.5), 0.0)
+    );
+}
+
+// the book scene with its small diffuse spheres bouncing: each goes up by up to half its
+// height over the shutter, through add_moving(center0, center1, radius, material_desc). the
+// rest of the scene is exactly book_scene's. render with bouncing_camera.
+template <typename AddSphere, typename AddMoving>
+void bouncing_scene(AddSphere&& add_sphere, AddMoving&& add_moving) {
+    pcg32 rng(13, 0); // separate from book_scene's, so its spheres don't change
+    book_scene([&](const point3& center, double radius, const material_desc& m) {
+        if (radius < 1 && m.type == material_desc::kind::lambertian)
+            add_moving(center, center + vec3(0, random_double(rng, 0, 0.5), 0), radius, m);
+        else
+            add_sphere(center, radius, m);
+    });
+}
+
+// the cornell box: a closed room lit by a light in its ceiling and a small sphere light
+// in a corner, with a diffuse and a glass ball. no light gets in from outside, so the
+// lights are the only source, and quads go in through add_quad(q, u, v, material_desc).
+// render with cornell_camera.
+template <typename AddSphere, typename AddQuad>
+void cornell_scene(AddSphere&& add_sphere, AddQuad&& add_quad) {
+    auto red   = material_desc::make_lambertian(colour(0.65, 0.05, 0.05));
+    auto white = material_desc::make_lambertian(colour(0.73, 0.73, 0.73));
+    auto green = material_desc::make_lambertian(colour(0.12, 0.45, 0.15));
+
+    // walls face into the room
+    add_quad(point3(555, 0, 0), vec3(0, 0, 555), vec3(0, 555, 0), green);
+    add_quad(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red);
+    add_quad(point3(0, 0, 0), vec3(0, 0, 555), vec3(555, 0, 0), white);       // floor
+    add_quad(point3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555), white); // ceiling
+    add_quad(point3(0, 0, 555), vec3(0, 555, 0), vec3(555, 0, 0), white);     // back
+
+    // just below the ceiling, lit side down
+    add_quad(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), material_desc::make_emissive(colour(15, 15, 15)));
+    add_sphere(point3(480, 40, 140), 25, material_desc::make_emissive(colour(12, 8, 4)));
+
+    add_sphere(point3(190, 90, 190), 90, white);
+    add_sphere(point3(370, 90, 350), 90, material_desc::make_dielectric(1.5));
+}
+
+inline void cornell_camera(camera& cam) {
+    cam.aspect_ratio      = 1.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 64;
+    cam.max_depth         = 50;
+
+    cam.vfov          = 40;
+    cam.lookfrom      = point3(278, 278, -800);
+    cam.lookat        = point3(278, 278, 0);
+    cam.vup           = vec3(0, 1, 0);
+    cam.defocus_angle = 0;
+    cam.sky_light     = false;
+}
+
+// n small spheres scattered over a square of ground, mostly diffuse with some metal: a lot
+// of geometry and short paths, to stress intersection rather than shading.
+template <typename AddSphere>
+void dense_scene(AddSphere&& add_sphere, int n = 10000) {
+    pcg32 rng(7, 0);
+    double side = std::sqrt(double(n));
+
+    add_sphere(point3(0, -1000, 0), 1000, material_desc::make_lambertian(colour(0.5, 0.5, 0.5)));
+
+    for (int k = 0; k < n; k++) {
+        point3 center(side * (random_double(rng) - 0.5), 0.2, side * (random_double(rng) - 0.5));
+        if (random_double(rng) < 0.9)
+            add_sphere(center, 0.2, material_desc::make_lambertian(colour::random(rng) * colour::random(rng)));
+        else
+            add_sphere(center, 0.2, material_desc::make_metal(colour::random(rng, 0.5, 1), 0));
+    }
+}
+
+// looks across the dense_scene square from above one edge
+inline void dense_camera(camera& cam, int n = 10000) {
+    double side = std::sqrt(double(n));
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 16;
+    cam.max_depth         = 50;
+
+    cam.vfov          = 40;
+    cam.lookfrom      = point3(0, 0.15 * side + 2, 0.6 * side);
+    cam.lookat        = point3(0, 0, 0);
+    cam.vup           = vec3(0, 1, 0);
+    cam.defocus_angle = 0;
+}
+
+// the book's layout with nearly every sphere glass, so most paths go through several
+// refractions: few objects, long paths. uses book_camera.
+template <typename AddSphere>
+void glass_scene(AddSphere&& add_sphere) {
+    pcg32 rng(11, 0);
+
+    add_sphere(point3(0, -1000, 0), 1000, material_desc::make_lambertian(colour(0.5, 0.5, 0.5)));
+
+    for (int a = -5; a < 5; a++) {
+        for (int b = -5; b < 5; b++) {
+            point3 center(a + 0.9 * random_double(rng), 0.2, b + 0.9 * random_double(rng));
+            if ((center - point3(4, 0.2, 0)).length() <= 0.9)
+                continue;
+            if (random_double(rng) < 0.85)
+                add_sphere(center, 0.2, material_desc::make_dielectric(random_double(rng, 1.3, 1.8)));
+            else
+                add_sphere(center, 0.2, material_desc::make_lambertian(colour::random(rng) * colour::random(rng)));
+        }
+    }
+
+    add_sphere(point3(0, 1, 0), 1.0, material_desc::make_dielectric(1.5));
+    add_sphere(point3(-4, 1, 0), 1.0, material_desc::make_dielectric(1.5));
+    add_sphere(point3(4, 1, 0), 1.0, material_desc::make_dielectric(2.4));
+}
+
+inline void book_camera(camera& cam) {
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 1200;
+    cam.samples_per_pixel = 20; // when this is set at 500, it will take longer.
+    cam.max_depth         = 50;
+    cam.tile_size         = 16;
+
+    cam.vfov          = 20;
+    cam.lookfrom      = point3(13, 2, 3);
+    cam.lookat        = point3(0, 0, 0);
+    cam.vup           = vec3(0, 1, 0);
+    cam.defocus_angle = 0.6;
+    cam.focus_distance = 10.0;
+}
+
+// book_camera with the shutter open over the whole of bouncing_scene's motion
+inline void bouncing_camera(camera& cam) {
+    book_camera(cam);
+    cam.shutter_open = 0;
+    cam.shutter_close = 1;
+}
+
+#endif
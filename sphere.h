@@ -2,47 +2,111 @@
 #define SPHERE
 
 #include "hittable.h"
-#include <memory>
+#include "instrument.h"
 
-class sphere : public hittable {
-    public:
-        sphere(const point3& center, double radius, std::unique_ptr<material> material_ptr) : center(center), radius(std::fmax(0,radius)), material_ptr(std::move(material_ptr)) {
-        }
+// distance to the nearest hit of r on a sphere, if there is one in ray_t, shared by the
+// static and moving spheres
+inline bool hit_sphere(const point3& center, real radius, const ray& r, interval ray_t, real& t) {
+    RT_COUNT(sphere_hit);
+    vec3 oc = center - r.origin();
+    auto a = r.direction().length_squared();
+    auto h = dot(r.direction(), oc);
+    auto c = oc.length_squared() - radius*radius;
 
-        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            vec3 oc = center - r.origin();
-            auto a = r.direction().length_squared();
-            auto h = dot(r.direction(), oc);
-            auto c = oc.length_squared() - radius*radius;
+    auto discriminant = h*h - a*c;
+    if (discriminant < 0)
+        return false;
     
-            auto discriminant = h*h - a*c;
-            if (discriminant < 0)
+    // TODO: I want to use the quake3 fast inverse square root here
+    auto sqrtd = std::sqrt(discriminant);
+
+    // find the nearest root that lies in the acceptable range.
+    auto root = (h - sqrtd) / a;
+    if (!ray_t.surrounds(root)) {
+        root = (h + sqrtd) / a;
+        if (!ray_t.surrounds(root))
+            return false;
+    }
+
+    t = root;
+    return true;
+}
+
+// the surface at rec.t, once that's the closest hit
+inline void sphere_surface(const point3& center, real radius, const material* material_ptr,
+                           const ray& r, hit_record& rec) {
+    rec.p = r.at(rec.t);
+    rec.normal = (rec.p - center) / radius;
+    rec.set_face_normal(r, rec.normal);
+    rec.material_ptr = material_ptr;
+}
+
+class sphere final : public hittable {
+    public:
+        // the material isn't owned, it belongs to whatever made the sphere (usually a
+        // hittable_list, which shares it between every sphere with the same parameters)
+        sphere(const point3& center, real radius, const material* material_ptr) : center(center), radius(std::fmax(real(0),radius)), material_ptr(material_ptr) {}
+
+        bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+            if (!hit_sphere(center, radius, r, ray_t, rec.t))
                 return false;
-            
-            // TODO: I want to use the quake3 fast inverse square root here
-            auto sqrtd = std::sqrt(discriminant);
-    
-            // find the nearest root that lies in the acceptable range.
-            auto root = (h - sqrtd) / a;
-            if (!ray_t.surrounds(root)) {
-                root = (h + sqrtd) / a;
-                if (!ray_t.surrounds(root))
-                    return false;
-            }
-    
-            rec.t = root;
-            rec.p = r.at(rec.t);
-            rec.normal = (rec.p - center) / radius;
-            rec.set_face_normal(r, rec.normal);
-            rec.material_ptr = material_ptr.get();
-    
+            rec.object = this;
             return true;
         }
+
+        void surface(const ray& r, hit_record& rec) const override {
+            sphere_surface(center, radius, material_ptr, r, rec);
+        }
+
+        // worked out on demand rather than stored: only the bvh build asks, and it halves
+        // the size of a sphere
+        aabb bounding_box() const override {
+            auto rvec = vec3(radius, radius, radius);
+            return aabb(center - rvec, center + rvec);
+        }
     
     private:
         point3 center;
-        double radius;    
-        std::unique_ptr<material> material_ptr;
+        real radius;    
+        const material* material_ptr;
+};
+
+/*
+A sphere moving in a straight line, at center0 at time 0 and center1 at time 1 (and on the
+same line before and after). Rays hit it where it is at their time, so a camera with an open
+shutter renders it blurred. Its bounding box covers the whole move over [0, 1], which is
+what the bvh culls with; shutters reaching outside that would need a bigger box.
+*/
+class moving_sphere final : public hittable {
+    public:
+        moving_sphere(const point3& center0, const point3& center1, real radius, const material* material_ptr)
+            : center0(center0), velocity(center1 - center0), radius(std::fmax(real(0),radius)), material_ptr(material_ptr) {}
+
+        bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+            if (!hit_sphere(center(r.time()), radius, r, ray_t, rec.t))
+                return false;
+            rec.object = this;
+            return true;
+        }
+
+        void surface(const ray& r, hit_record& rec) const override {
+            sphere_surface(center(r.time()), radius, material_ptr, r, rec);
+        }
+
+        aabb bounding_box() const override {
+            auto rvec = vec3(radius, radius, radius);
+            aabb start(center0 - rvec, center0 + rvec);
+            aabb end(center(1) - rvec, center(1) + rvec);
+            return aabb(start, end);
+        }
+
+        point3 center(real time) const { return center0 + time * velocity; }
+
+    private:
+        point3 center0;
+        vec3 velocity; // per unit of time
+        real radius;
+        const material* material_ptr;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,359 @@
+#ifndef SPHERE_SOUP_H
+#define SPHERE_SOUP_H
+
+#include "hittable.h"
+#include "bvh.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SPHERE_SOUP_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+A whole set of spheres stored as structure-of-arrays (cx[], cy[], cz[], r[], material_id[])
+so one ray can be tested against several spheres per instruction.
+Spheres are grouped into small bvh leaves, each a contiguous run of the arrays, and the
+leaf kernel is picked at runtime: avx2 (4 spheres at once), sse4.1 (2) or plain scalar.
+*/
+class sphere_soup : public hittable {
+  public:
+    enum class simd_level { scalar, sse41, avx2 };
+
+    sphere_soup() : kernel(kernel_for(detect_simd())) {}
+
+    // materials live in the soup and are referenced by index, so spheres can share them
+    int add_material(std::unique_ptr<material> m) {
+        materials.push_back(std::move(m));
+        return int(materials.size()) - 1;
+    }
+
+    void add(const point3& center, double radius, int material_id) {
+        cx.push_back(center.x());
+        cy.push_back(center.y());
+        cz.push_back(center.z());
+        r.push_back(std::fmax(0, radius));
+        mat.push_back(material_id);
+        tree.nodes.clear(); // any existing tree no longer covers every sphere
+    }
+
+    // same shape as adding a sphere to a hittable_list, for spheres with their own material
+    void add(const point3& center, double radius, std::unique_ptr<material> m) {
+        add(center, radius, add_material(std::move(m)));
+    }
+
+    size_t size() const { return r.size(); }
+
+    // replaces all spheres with ready-made arrays (e.g. from a scene file), taking them over
+    // without copying. the arrays must all be the same length.
+    void assign(std::vector<double> x, std::vector<double> y, std::vector<double> z,
+                std::vector<double> radius, std::vector<int32_t> material_ids) {
+        cx = std::move(x);
+        cy = std::move(y);
+        cz = std::move(z);
+        r = std::move(radius);
+        mat = std::move(material_ids);
+        tree.nodes.clear();
+    }
+
+    // groups the spheres into a bvh with leaves of up to leaf_size spheres. without this,
+    // hit() runs the kernel over every sphere, which is fine for a few dozen of them.
+    // returns the new sphere order (as bvh_tree::build does) for callers keeping their own
+    // copy of the sphere list in step.
+    std::vector<int> build(int leaf_size = 8) {
+        std::vector<aabb> boxes(size());
+        for (size_t i = 0; i < size(); i++)
+            boxes[i] = sphere_box(int(i));
+
+        // a leaf of spheres costs about one test per simd group rather than one per sphere
+        int lanes = detect_simd() == simd_level::avx2 ? 4 : (detect_simd() == simd_level::sse41 ? 2 : 1);
+        auto order = tree.build(boxes, leaf_size, 1.0 / lanes);
+        permute(cx, order);
+        permute(cy, order);
+        permute(cz, order);
+        permute(r, order);
+        permute(mat, order);
+        return order;
+    }
+
+    // uses a previously built tree instead of building one, e.g. one saved with the scene.
+    // the spheres must already be in that tree's leaf order.
+    void use_tree(const bvh_node* nodes, size_t count) {
+        tree.nodes.assign(nodes, nodes + count);
+    }
+
+    const std::vector<bvh_node>& tree_nodes() const { return tree.nodes; }
+
+    // override the detected kernel, for A/B comparisons
+    void use_simd(simd_level level) {
+        kernel = kernel_for(level);
+    }
+
+    static simd_level detect_simd() {
+#if SPHERE_SOUP_X86 && defined(__GNUC__)
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return simd_level::avx2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return simd_level::sse41;
+#endif
+        return simd_level::scalar;
+    }
+
+    bool intersect(const ray& ray_in, interval ray_t, hit_record& rec) const override {
+        int closest = -1;
+        // the kernels work in double whatever real is, like the sphere arrays. the winner's
+        // distance is the one its kernel found: recomputing it with another kernel (without
+        // fma, say) can miss a grazing hit the first one saw
+        double closest_t = ray_t.max;
+
+        if (tree.nodes.empty()) {
+            ray_counters::count_tests(0, size());
+            closest = kernel(*this, 0, int(size()), ray_in, ray_t.min, closest_t);
+        } else {
+            tree.traverse(ray_in, ray_t, [&](int first, int count, interval& t) {
+                double t_max = t.max;
+                int k = kernel(*this, first, count, ray_in, t.min, t_max);
+                if (k < 0)
+                    return false;
+                t.max = t_max;
+                closest_t = t_max;
+                closest = k;
+                return true;
+            });
+        }
+
+        if (closest < 0)
+            return false;
+
+        rec.t = real(closest_t);
+        rec.object = this;
+        rec.primitive = closest;
+        return true;
+    }
+
+    // only the winning sphere gets a full hit record
+    void surface(const ray& ray_in, hit_record& rec) const override {
+        int i = rec.primitive;
+        point3 center(cx[i], cy[i], cz[i]);
+        rec.p = ray_in.at(rec.t);
+        rec.set_face_normal(ray_in, (rec.p - center) / r[i]);
+        rec.material_ptr = materials[mat[i]].get();
+    }
+
+    aabb bounding_box() const override {
+        if (!tree.nodes.empty())
+            return tree.bounding_box();
+        aabb box;
+        for (size_t i = 0; i < size(); i++)
+            box = aabb(box, sphere_box(int(i)));
+        return box;
+    }
+
+  private:
+    // leaf kernel: tests spheres [first, first+count), returns the closest one hit inside
+    // (t_min, t_max) or -1, and shrinks t_max to its distance
+    using kernel_fn = int (*)(const sphere_soup&, int, int, const ray&, double, double&);
+
+    std::vector<double> cx, cy, cz, r;
+    std::vector<int32_t> mat;
+    std::vector<std::unique_ptr<material>> materials;
+    bvh_tree tree;
+    kernel_fn kernel;
+
+    aabb sphere_box(int i) const {
+        vec3 rvec(r[i], r[i], r[i]);
+        point3 center(cx[i], cy[i], cz[i]);
+        return aabb(center - rvec, center + rvec);
+    }
+
+    template <typename T>
+    static void permute(std::vector<T>& v, const std::vector<int>& order) {
+        std::vector<T> sorted(v.size());
+        for (size_t i = 0; i < order.size(); i++)
+            sorted[i] = v[order[i]];
+        v = std::move(sorted);
+    }
+
+    static kernel_fn kernel_for(simd_level level) {
+#if SPHERE_SOUP_X86 && defined(__GNUC__)
+        if (level == simd_level::avx2)  return hit_avx2;
+        if (level == simd_level::sse41) return hit_sse41;
+#endif
+        return hit_scalar;
+    }
+
+    static int hit_scalar(const sphere_soup& s, int first, int count, const ray& ray_in,
+                          double t_min, double& t_max) {
+        const vec3& d = ray_in.direction();
+        const point3& o = ray_in.origin();
+        double a = d.length_squared();
+        double inv_a = 1.0 / a;
+        int closest = -1;
+
+        for (int i = first; i < first + count; i++) {
+            double ocx = s.cx[i] - o.x(), ocy = s.cy[i] - o.y(), ocz = s.cz[i] - o.z();
+            double h = d.x()*ocx + d.y()*ocy + d.z()*ocz;
+            double c = ocx*ocx + ocy*ocy + ocz*ocz - s.r[i]*s.r[i];
+            double discriminant = h*h - a*c;
+            if (discriminant < 0)
+                continue;
+
+            double sqrtd = std::sqrt(discriminant);
+            double root = (h - sqrtd) * inv_a;
+            if (root <= t_min || root >= t_max) {
+                root = (h + sqrtd) * inv_a;
+                if (root <= t_min || root >= t_max)
+                    continue;
+            }
+            t_max = root;
+            closest = i;
+        }
+        return closest;
+    }
+
+#if SPHERE_SOUP_X86 && defined(__GNUC__)
+    __attribute__((target("avx2,fma")))
+    static int hit_avx2(const sphere_soup& s, int first, int count, const ray& ray_in,
+                        double t_min, double& t_max) {
+        const vec3& d = ray_in.direction();
+        const point3& o = ray_in.origin();
+        double a = d.length_squared();
+
+        const __m256d ox = _mm256_set1_pd(o.x()), oy = _mm256_set1_pd(o.y()), oz = _mm256_set1_pd(o.z());
+        const __m256d dx = _mm256_set1_pd(d.x()), dy = _mm256_set1_pd(d.y()), dz = _mm256_set1_pd(d.z());
+        const __m256d va = _mm256_set1_pd(a);
+        const __m256d inv_a = _mm256_set1_pd(1.0 / a);
+        const __m256d tmin = _mm256_set1_pd(t_min);
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d no_hit = _mm256_set1_pd(infinity);
+
+        // each lane keeps its own closest distance and sphere index
+        __m256d best_t = _mm256_set1_pd(t_max);
+        __m256d best_i = _mm256_set1_pd(-1);
+        __m256d idx = _mm256_set_pd(first + 3, first + 2, first + 1, first);
+        const __m256d four = _mm256_set1_pd(4);
+
+        int end = first + count;
+        int i = first;
+        for (; i + 4 <= end; i += 4) {
+            __m256d ocx = _mm256_sub_pd(_mm256_loadu_pd(&s.cx[i]), ox);
+            __m256d ocy = _mm256_sub_pd(_mm256_loadu_pd(&s.cy[i]), oy);
+            __m256d ocz = _mm256_sub_pd(_mm256_loadu_pd(&s.cz[i]), oz);
+            __m256d rad = _mm256_loadu_pd(&s.r[i]);
+
+            __m256d h = _mm256_fmadd_pd(dz, ocz, _mm256_fmadd_pd(dy, ocy, _mm256_mul_pd(dx, ocx)));
+            __m256d c = _mm256_fmadd_pd(ocz, ocz, _mm256_fmadd_pd(ocy, ocy, _mm256_mul_pd(ocx, ocx)));
+            c = _mm256_fnmadd_pd(rad, rad, c);
+            __m256d disc = _mm256_fnmadd_pd(va, c, _mm256_mul_pd(h, h));
+
+            __m256d valid = _mm256_cmp_pd(disc, zero, _CMP_GE_OQ);
+            if (_mm256_movemask_pd(valid) == 0) {
+                // most groups miss entirely, skip the sqrt and root selection
+                idx = _mm256_add_pd(idx, four);
+                continue;
+            }
+            __m256d sqrtd = _mm256_sqrt_pd(_mm256_max_pd(disc, zero));
+            __m256d root0 = _mm256_mul_pd(_mm256_sub_pd(h, sqrtd), inv_a);
+            __m256d root1 = _mm256_mul_pd(_mm256_add_pd(h, sqrtd), inv_a);
+
+            __m256d in0 = _mm256_and_pd(_mm256_cmp_pd(root0, tmin, _CMP_GT_OQ), _mm256_cmp_pd(root0, best_t, _CMP_LT_OQ));
+            __m256d in1 = _mm256_and_pd(_mm256_cmp_pd(root1, tmin, _CMP_GT_OQ), _mm256_cmp_pd(root1, best_t, _CMP_LT_OQ));
+
+            // prefer the near root, fall back to the far one (ray starting inside the sphere)
+            __m256d t = _mm256_blendv_pd(_mm256_blendv_pd(no_hit, root1, in1), root0, in0);
+            __m256d take = _mm256_and_pd(valid, _mm256_or_pd(in0, in1));
+
+            best_t = _mm256_blendv_pd(best_t, t, take);
+            best_i = _mm256_blendv_pd(best_i, idx, take);
+            idx = _mm256_add_pd(idx, four);
+        }
+
+        alignas(32) double lane_t[4], lane_i[4];
+        _mm256_store_pd(lane_t, best_t);
+        _mm256_store_pd(lane_i, best_i);
+        int closest = reduce_lanes(lane_t, lane_i, 4, t_max);
+
+        int tail = hit_scalar(s, i, end - i, ray_in, t_min, t_max);
+        return tail >= 0 ? tail : closest;
+    }
+
+    __attribute__((target("sse4.1")))
+    static int hit_sse41(const sphere_soup& s, int first, int count, const ray& ray_in,
+                         double t_min, double& t_max) {
+        const vec3& d = ray_in.direction();
+        const point3& o = ray_in.origin();
+        double a = d.length_squared();
+
+        const __m128d ox = _mm_set1_pd(o.x()), oy = _mm_set1_pd(o.y()), oz = _mm_set1_pd(o.z());
+        const __m128d dx = _mm_set1_pd(d.x()), dy = _mm_set1_pd(d.y()), dz = _mm_set1_pd(d.z());
+        const __m128d va = _mm_set1_pd(a);
+        const __m128d inv_a = _mm_set1_pd(1.0 / a);
+        const __m128d tmin = _mm_set1_pd(t_min);
+        const __m128d zero = _mm_setzero_pd();
+        const __m128d no_hit = _mm_set1_pd(infinity);
+
+        __m128d best_t = _mm_set1_pd(t_max);
+        __m128d best_i = _mm_set1_pd(-1);
+        __m128d idx = _mm_set_pd(first + 1, first);
+        const __m128d two = _mm_set1_pd(2);
+
+        int end = first + count;
+        int i = first;
+        for (; i + 2 <= end; i += 2) {
+            __m128d ocx = _mm_sub_pd(_mm_loadu_pd(&s.cx[i]), ox);
+            __m128d ocy = _mm_sub_pd(_mm_loadu_pd(&s.cy[i]), oy);
+            __m128d ocz = _mm_sub_pd(_mm_loadu_pd(&s.cz[i]), oz);
+            __m128d rad = _mm_loadu_pd(&s.r[i]);
+
+            __m128d h = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, ocx), _mm_mul_pd(dy, ocy)), _mm_mul_pd(dz, ocz));
+            __m128d c = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)), _mm_mul_pd(ocz, ocz));
+            c = _mm_sub_pd(c, _mm_mul_pd(rad, rad));
+            __m128d disc = _mm_sub_pd(_mm_mul_pd(h, h), _mm_mul_pd(va, c));
+
+            __m128d valid = _mm_cmpge_pd(disc, zero);
+            if (_mm_movemask_pd(valid) == 0) {
+                idx = _mm_add_pd(idx, two);
+                continue;
+            }
+            __m128d sqrtd = _mm_sqrt_pd(_mm_max_pd(disc, zero));
+            __m128d root0 = _mm_mul_pd(_mm_sub_pd(h, sqrtd), inv_a);
+            __m128d root1 = _mm_mul_pd(_mm_add_pd(h, sqrtd), inv_a);
+
+            __m128d in0 = _mm_and_pd(_mm_cmpgt_pd(root0, tmin), _mm_cmplt_pd(root0, best_t));
+            __m128d in1 = _mm_and_pd(_mm_cmpgt_pd(root1, tmin), _mm_cmplt_pd(root1, best_t));
+
+            __m128d t = _mm_blendv_pd(_mm_blendv_pd(no_hit, root1, in1), root0, in0);
+            __m128d take = _mm_and_pd(valid, _mm_or_pd(in0, in1));
+
+            best_t = _mm_blendv_pd(best_t, t, take);
+            best_i = _mm_blendv_pd(best_i, idx, take);
+            idx = _mm_add_pd(idx, two);
+        }
+
+        alignas(16) double lane_t[2], lane_i[2];
+        _mm_store_pd(lane_t, best_t);
+        _mm_store_pd(lane_i, best_i);
+        int closest = reduce_lanes(lane_t, lane_i, 2, t_max);
+
+        int tail = hit_scalar(s, i, end - i, ray_in, t_min, t_max);
+        return tail >= 0 ? tail : closest;
+    }
+#endif
+
+    // picks the closest of the per-lane results and writes its distance to t_max
+    static int reduce_lanes(const double* lane_t, const double* lane_i, int lanes, double& t_max) {
+        int closest = -1;
+        for (int k = 0; k < lanes; k++) {
+            if (lane_i[k] >= 0 && lane_t[k] < t_max) {
+                t_max = lane_t[k];
+                closest = int(lane_i[k]);
+            }
+        }
+        return closest;
+    }
+};
+
+#endif
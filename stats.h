@@ -0,0 +1,115 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/*
+Render statistics. The hot paths count into ray_counters, one set per thread so nothing is
+shared while rendering; the camera resets each worker's counters when it starts and gathers
+them into a render_stats when it's done (see camera::stats).
+
+They're kept in every build, so any build's benchmark report has them: the bvh and lists
+tally their tests as they go and hand them over once per query (count_tests), and rays are
+counted once each.
+*/
+
+struct ray_counters {
+    static constexpr int max_depth = 64; // deeper bounces are counted as this depth - 1
+
+    uint64_t node_tests = 0;      // ray-box tests in bvh traversal
+    uint64_t primitive_tests = 0; // ray-primitive tests
+    uint64_t rays_at_depth[max_depth] = {};   // rays traced per bounce, 0 being camera rays
+    double seconds_at_depth[max_depth] = {};  // time spent on each bounce, when timed
+
+    // this thread's counters
+    static ray_counters& local() {
+        thread_local ray_counters counters;
+        return counters;
+    }
+
+    // adds to this thread's test counts
+    static void count_tests(uint64_t nodes, uint64_t primitives) {
+        ray_counters& counters = local();
+        counters.node_tests += nodes;
+        counters.primitive_tests += primitives;
+    }
+
+    uint64_t rays() const {
+        uint64_t n = 0;
+        for (uint64_t r : rays_at_depth)
+            n += r;
+        return n;
+    }
+
+    void count_ray(int depth, uint64_t n = 1) {
+        rays_at_depth[depth < max_depth ? depth : max_depth - 1] += n;
+    }
+
+    double* seconds_slot(int depth) {
+        return &seconds_at_depth[depth < max_depth ? depth : max_depth - 1];
+    }
+};
+
+// adds the time from construction to destruction to *total, or does nothing if total is null
+class scoped_seconds {
+  public:
+    explicit scoped_seconds(double* total) : total(total) {
+        if (total)
+            start = std::chrono::steady_clock::now();
+    }
+    ~scoped_seconds() {
+        if (total)
+            *total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    scoped_seconds(const scoped_seconds&) = delete;
+    scoped_seconds& operator=(const scoped_seconds&) = delete;
+
+  private:
+    double* total;
+    std::chrono::steady_clock::time_point start;
+};
+
+struct render_stats {
+    struct thread {
+        double busy_seconds = 0; // time spent rendering tiles
+        int    tiles = 0;        // tiles rendered
+    };
+
+    double render_seconds = 0;
+    bool   bounces_timed = false; // whether seconds_at_depth was filled in
+    std::vector<thread> threads;
+    ray_counters totals;          // every thread's counters summed
+
+    uint64_t primary_rays() const { return totals.rays_at_depth[0]; }
+
+    uint64_t secondary_rays() const {
+        uint64_t n = 0;
+        for (int d = 1; d < ray_counters::max_depth; d++)
+            n += totals.rays_at_depth[d];
+        return n;
+    }
+
+    uint64_t total_rays() const { return primary_rays() + secondary_rays(); }
+
+    // deepest bounce any ray reached, plus one
+    int depth_count() const {
+        int n = 0;
+        for (int d = 0; d < ray_counters::max_depth; d++)
+            if (totals.rays_at_depth[d] > 0)
+                n = d + 1;
+        return n;
+    }
+
+    void add(const ray_counters& c) {
+        totals.node_tests += c.node_tests;
+        totals.primitive_tests += c.primitive_tests;
+        for (int d = 0; d < ray_counters::max_depth; d++) {
+            totals.rays_at_depth[d] += c.rays_at_depth[d];
+            totals.seconds_at_depth[d] += c.seconds_at_depth[d];
+        }
+    }
+};
+
+#endif
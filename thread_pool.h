@@ -0,0 +1,85 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// render threads to use when none are asked for: one per hardware thread
+inline int default_thread_count() {
+    int n = int(std::thread::hardware_concurrency());
+    return n > 0 ? n : 4;
+}
+
+/*
+A fixed set of threads kept for a batch of renders, so each frame of an animation doesn't
+start and join a thread per core (and the threads' thread_local buffers, such as the
+wavefront queues, are reused). The camera uses one when it's given one, see camera::pool.
+*/
+class thread_pool {
+  public:
+    explicit thread_pool(int size) {
+        for (int i = 0; i < size; i++)
+            workers.emplace_back([this, i] { work(i); });
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            quitting = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers)
+            t.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    int size() const { return int(workers.size()); }
+
+    // runs fn(thread_index) once on every thread of the pool and waits for them all to
+    // return. one run at a time: it isn't safe to call from two threads at once.
+    void run(const std::function<void(int)>& fn) {
+        std::unique_lock<std::mutex> lock(mtx);
+        job = &fn;
+        running = size();
+        generation++;
+        wake.notify_all();
+        done.wait(lock, [this] { return running == 0; });
+        job = nullptr;
+    }
+
+  private:
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable wake, done;
+    const std::function<void(int)>* job = nullptr;
+    uint64_t generation = 0; // bumped for every run, so a thread knows there's a new job
+    int running = 0;         // threads still on the current job
+    bool quitting = false;
+
+    void work(int index) {
+        uint64_t seen = 0;
+        while (true) {
+            const std::function<void(int)>* fn;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                wake.wait(lock, [&] { return quitting || generation != seen; });
+                if (quitting)
+                    return;
+                seen = generation;
+                fn = job;
+            }
+            (*fn)(index);
+            std::lock_guard<std::mutex> lock(mtx);
+            if (--running == 0)
+                done.notify_one();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "aabb.h"
+
+#include <cmath>
+
+/*
+Affine transform: a 3x3 linear part (rotation, scale, shear) followed by a translation, held
+as the top three rows of a 4x4 matrix. Transforms compose like matrices, so a * b applies b
+first, e.g. translate(p) * rotate(axis, angle) * scale(s) scales, then rotates, then moves.
+*/
+class affine {
+  public:
+    real m[3][4];
+
+    // identity
+    affine() : m{ {1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0} } {}
+
+    static affine translate(const vec3& offset) {
+        affine a;
+        for (int r = 0; r < 3; r++)
+            a.m[r][3] = offset[r];
+        return a;
+    }
+
+    static affine scale(const vec3& s) {
+        affine a;
+        for (int r = 0; r < 3; r++)
+            a.m[r][r] = s[r];
+        return a;
+    }
+
+    static affine scale(real s) { return scale(vec3(s, s, s)); }
+
+    // rotation by angle degrees about axis, counter-clockwise looking down the axis
+    static affine rotate(const vec3& axis, double degrees) {
+        vec3 u = unit_vector(axis);
+        double theta = degrees_to_radians(degrees);
+        real c = std::cos(theta), s = std::sin(theta), t = 1 - c;
+        affine a;
+        a.m[0][0] = t*u.x()*u.x() + c;       a.m[0][1] = t*u.x()*u.y() - s*u.z(); a.m[0][2] = t*u.x()*u.z() + s*u.y();
+        a.m[1][0] = t*u.x()*u.y() + s*u.z(); a.m[1][1] = t*u.y()*u.y() + c;       a.m[1][2] = t*u.y()*u.z() - s*u.x();
+        a.m[2][0] = t*u.x()*u.z() - s*u.y(); a.m[2][1] = t*u.y()*u.z() + s*u.x(); a.m[2][2] = t*u.z()*u.z() + c;
+        return a;
+    }
+
+    point3 point(const point3& p) const {
+        return point3(row(0, p) + m[0][3], row(1, p) + m[1][3], row(2, p) + m[2][3]);
+    }
+
+    // directions skip the translation
+    vec3 vector(const vec3& v) const {
+        return vec3(row(0, v), row(1, v), row(2, v));
+    }
+
+    // a normal transformed by this transform's inverse, i.e. by the transpose of its linear
+    // part: what turns a normal back out of the space the inverse maps into
+    vec3 inverse_normal(const vec3& n) const {
+        return vec3(m[0][0]*n.x() + m[1][0]*n.y() + m[2][0]*n.z(),
+                    m[0][1]*n.x() + m[1][1]*n.y() + m[2][1]*n.z(),
+                    m[0][2]*n.x() + m[1][2]*n.y() + m[2][2]*n.z());
+    }
+
+    affine operator*(const affine& b) const {
+        affine a;
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 4; c++) {
+                a.m[r][c] = m[r][0]*b.m[0][c] + m[r][1]*b.m[1][c] + m[r][2]*b.m[2][c];
+                if (c == 3)
+                    a.m[r][c] += m[r][3];
+            }
+        }
+        return a;
+    }
+
+    // the linear part has to be invertible, i.e. no zero scales
+    affine inverse() const {
+        // inverse of the linear part from its cofactors
+        real c00 = m[1][1]*m[2][2] - m[1][2]*m[2][1];
+        real c01 = m[1][2]*m[2][0] - m[1][0]*m[2][2];
+        real c02 = m[1][0]*m[2][1] - m[1][1]*m[2][0];
+        real inv_det = 1 / (m[0][0]*c00 + m[0][1]*c01 + m[0][2]*c02);
+
+        affine a;
+        a.m[0][0] = c00 * inv_det;
+        a.m[0][1] = (m[0][2]*m[2][1] - m[0][1]*m[2][2]) * inv_det;
+        a.m[0][2] = (m[0][1]*m[1][2] - m[0][2]*m[1][1]) * inv_det;
+        a.m[1][0] = c01 * inv_det;
+        a.m[1][1] = (m[0][0]*m[2][2] - m[0][2]*m[2][0]) * inv_det;
+        a.m[1][2] = (m[0][2]*m[1][0] - m[0][0]*m[1][2]) * inv_det;
+        a.m[2][0] = c02 * inv_det;
+        a.m[2][1] = (m[0][1]*m[2][0] - m[0][0]*m[2][1]) * inv_det;
+        a.m[2][2] = (m[0][0]*m[1][1] - m[0][1]*m[1][0]) * inv_det;
+
+        // and the translation undone: -inverse(linear) * t
+        for (int r = 0; r < 3; r++)
+            a.m[r][3] = -(a.m[r][0]*m[0][3] + a.m[r][1]*m[1][3] + a.m[r][2]*m[2][3]);
+        return a;
+    }
+
+    // box around the transformed corners of box
+    aabb box(const aabb& b) const {
+        aabb out;
+        for (int corner = 0; corner < 8; corner++) {
+            point3 p(corner & 1 ? b.x.max : b.x.min, corner & 2 ? b.y.max : b.y.min, corner & 4 ? b.z.max : b.z.min);
+            point3 q = point(p);
+            out = aabb(out, aabb(q, q));
+        }
+        return out;
+    }
+
+  private:
+    real row(int r, const vec3& v) const {
+        return m[r][0]*v.x() + m[r][1]*v.y() + m[r][2]*v.z();
+    }
+};
+
+#endif
@@ -1,151 +1,197 @@
 #ifndef VEC3_H
 #define VEC3_H
 
+#include <type_traits>
 
-class vec3 {
+// 3d vector over scalar type T. the renderer uses vec3, i.e. vec3_t<real>, see rtweekend.h
+template <typename T>
+class vec3_t {
     public:
-        double e[3];
+        T e[3];
 
         // init with no args, or 3 args
-        vec3() : e{0,0,0} {}
-        vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+        vec3_t() : e{0,0,0} {}
+        vec3_t(T e0, T e1, T e2) : e{e0, e1, e2} {}
+
+        // changing precision has to be asked for
+        template <typename U>
+        explicit vec3_t(const vec3_t<U>& v) : e{T(v.e[0]), T(v.e[1]), T(v.e[2])} {}
 
         // accessors
-        double x() const { return e[0]; }
-        double y() const { return e[1]; }
-        double z() const { return e[2]; }
+        T x() const { return e[0]; }
+        T y() const { return e[1]; }
+        T z() const { return e[2]; }
 
         // operators, overriding
-        vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-        double operator[](int i) const { return e[i]; }
-        double& operator[](int i) { return e[i]; }
+        vec3_t operator-() const { return vec3_t(-e[0], -e[1], -e[2]); }
+        T operator[](int i) const { return e[i]; }
+        T& operator[](int i) { return e[i]; }
 
-        vec3& operator+=(const vec3 &v) {
+        vec3_t& operator+=(const vec3_t &v) {
             e[0] += v.e[0];
             e[1] += v.e[1];
             e[2] += v.e[2];
             return *this;
         }
 
-        vec3& operator*=(const double f) {
+        vec3_t& operator*=(const T f) {
             e[0] *= f;
             e[1] *= f;
             e[2] *= f;
             return *this;
         }
 
-        vec3& operator/=(const double f) {
+        vec3_t& operator/=(const T f) {
             return *this *= 1/f;
         }
 
-        double length() const {
-            return sqrt(length_squared());
+        T length() const {
+            return std::sqrt(length_squared());
         }
 
-        double length_squared() const {
+        T length_squared() const {
             return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
         }
 
         bool near_zero() const {
             // Return true if the vector is close to zero in all dimensions.
-            const auto s = 1e-8;
-            return (fabs(e[0]) < s) && (fabs(e[1]) < s) && (fabs(e[2]) < s);
+            const T s = 1e-8;
+            return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
+        }
+
+        inline static vec3_t random() {
+            return vec3_t(random_double(), random_double(), random_double());
+        }
+
+        inline static vec3_t random(double min, double max) {
+            return vec3_t(random_double(min, max), random_double(min, max), random_double(min, max));
         }
 
-        inline static vec3 random() {
-            return vec3(random_double(), random_double(), random_double());
+        inline static vec3_t random(pcg32& rng) {
+            return vec3_t(random_double(rng), random_double(rng), random_double(rng));
         }
 
-        inline static vec3 random(double min, double max) {
-            return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+        inline static vec3_t random(pcg32& rng, double min, double max) {
+            return vec3_t(random_double(rng, min, max), random_double(rng, min, max), random_double(rng, min, max));
         }
 };
 
 // aliases
+using vec3 = vec3_t<real>;
 using point3 = vec3;
 
-// vec3 utility functions
-inline std::ostream& operator<<(std::ostream &out, const vec3 &v) {
+// vec3 utility functions. scalars are taken as T rather than deduced, so a double literal
+// times a float vector still picks these.
+template <typename T>
+inline std::ostream& operator<<(std::ostream &out, const vec3_t<T> &v) {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline vec3 operator+(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+template <typename T>
+inline vec3_t<T> operator+(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
-inline vec3 operator-(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+template <typename T>
+inline vec3_t<T> operator-(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 
-inline vec3 operator*(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline vec3 operator*(double t, const vec3 &v) {
-    return vec3(t*v.e[0], t*v.e[1], t*v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(std::type_identity_t<T> t, const vec3_t<T> &v) {
+    return vec3_t<T>(t*v.e[0], t*v.e[1], t*v.e[2]);
 }
 
-inline vec3 operator*(const vec3 &v, double t) {
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T> &v, std::type_identity_t<T> t) {
     return t * v;
 }
 
-inline vec3 operator/(vec3 v, double t) {
+template <typename T>
+inline vec3_t<T> operator/(vec3_t<T> v, std::type_identity_t<T> t) {
     return (1/t) * v;
 }
 
-inline double dot(const vec3 &u, const vec3 &v) {
+template <typename T>
+inline T dot(const vec3_t<T> &u, const vec3_t<T> &v) {
     return u.e[0] * v.e[0]
          + u.e[1] * v.e[1]
          + u.e[2] * v.e[2];
 }
 
-inline vec3 cross(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                     u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                     u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline vec3 unit_vector(vec3 v) {
+template <typename T>
+inline vec3_t<T> unit_vector(vec3_t<T> v) {
     return v / v.length();
 }
 
-inline vec3 random_unit_vector() {
-    // ensure it lies within the unit sphere, rejection policy.
-    // probably optimisable.
-    while (true) {
-        auto p = vec3::random(-1,1);
-        auto lensq = p.length_squared();
-        if (1e-160 < lensq && lensq <= 1) // magic number is to avoid floating-point abstraction
-            return p / sqrt(lensq);
+// uniform point on the unit sphere from a point (u, v) of the unit square: z uniform in
+// [-1, 1] and an angle round it, which by archimedes' hat-box theorem covers it evenly
+inline vec3 sphere_from_square(double u, double v) {
+    double z = 1 - 2 * u;
+    double r = std::sqrt(std::fmax(0.0, 1 - z * z));
+    double phi = 2 * pi * v;
+    return vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// uniform point in the unit disk (z = 0) from a point of the unit square, by shirley and
+// chiu's concentric mapping, which keeps nearby points of the square nearby in the disk
+inline vec3 disk_from_square(double u, double v) {
+    double a = 2 * u - 1, b = 2 * v - 1;
+    if (a == 0 && b == 0)
+        return vec3(0, 0, 0);
+    double r, phi;
+    if (std::fabs(a) > std::fabs(b)) {
+        r = a;
+        phi = (pi / 4) * (b / a);
+    } else {
+        r = b;
+        phi = (pi / 2) - (pi / 4) * (a / b);
     }
+    return vec3(r * std::cos(phi), r * std::sin(phi), 0);
 }
 
-inline vec3 random_on_hemisphere(const vec3& normal) {
-    auto on_unit_sphere = random_unit_vector();
+inline vec3 random_unit_vector(pcg32& rng) {
+    double u = rng.next_double();
+    return sphere_from_square(u, rng.next_double());
+}
+
+inline vec3 random_on_hemisphere(const vec3& normal, pcg32& rng) {
+    auto on_unit_sphere = random_unit_vector(rng);
     if (dot(on_unit_sphere, normal) > 0.0) // in the same hemisphere as the normal
         return on_unit_sphere;
     else
         return -on_unit_sphere;
 }
 
-inline vec3 reflect(const vec3& v, const vec3& n) {
+template <typename T>
+inline vec3_t<T> reflect(const vec3_t<T>& v, const vec3_t<T>& n) {
     return v - 2*dot(v,n)*n;
 }
 
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
+template <typename T>
+inline vec3_t<T> refract(const vec3_t<T>& uv, const vec3_t<T>& n, std::type_identity_t<T> etai_over_etat) {
     // uses snells law to calculate the refracted ray
-    auto cos_theta = std::fmin(dot(-uv, n), 1.0);
-    vec3 r_out_perp = etai_over_etat * (uv + cos_theta*n);
-    vec3 r_out_parallel = -std::sqrt(std::fabs(1.0 - r_out_perp.length_squared())) * n;
+    auto cos_theta = std::fmin(dot(-uv, n), T(1));
+    vec3_t<T> r_out_perp = etai_over_etat * (uv + cos_theta*n);
+    vec3_t<T> r_out_parallel = -std::sqrt(std::fabs(1 - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel;
 }
 
-inline vec3 random_in_unit_disk() {
-    while (true) {
-        auto p = vec3(random_double(-1,1), random_double(-1,1), 0);
-        if (p.length_squared() >= 1) continue;
-        return p;
-    }
+inline vec3 random_in_unit_disk(pcg32& rng) {
+    double u = rng.next_double();
+    return disk_from_square(u, rng.next_double());
 }
 
-#endif
\ No newline at end of file
+#endif
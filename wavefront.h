@@ -0,0 +1,294 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "hittable.h"
+#include "lights.h"
+#include "material.h"
+#include "stats.h"
+#include "instrument.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/*
+Paths in flight for the wavefront integrator, as structure of arrays so each stage only
+touches the fields it needs. Every path writes its result to its own slot, which lets the
+caller sum samples in a fixed order however the paths get shuffled on the way.
+*/
+struct path_queue {
+    std::vector<real> ox, oy, oz; // current ray origin
+    std::vector<real> dx, dy, dz; // current ray direction
+    std::vector<real> tm;         // ray time, fixed for the whole path
+    std::vector<real> tr, tg, tb; // throughput so far
+    std::vector<real> ar, ag, ab; // attenuation of the current bounce
+    std::vector<real> pdf;        // density the last bounce picked the ray with, for mis
+    std::vector<int>    slot;       // result index
+    std::vector<sampler> samples;   // the path's own sample stream
+    std::vector<hit_record> hits;
+    std::vector<uint8_t> alive;
+
+    size_t size() const { return slot.size(); }
+
+    void clear() { resize(0); }
+
+    void push(const ray& r, int result_slot, const sampler& stream) {
+        size_t k = size();
+        resize(k + 1);
+        set_ray(k, r);
+        tr[k] = tg[k] = tb[k] = 1;
+        pdf[k] = 0;
+        slot[k] = result_slot;
+        samples[k] = stream;
+        alive[k] = 1;
+    }
+
+    ray get_ray(size_t k) const {
+        return ray(point3(ox[k], oy[k], oz[k]), vec3(dx[k], dy[k], dz[k]), tm[k]);
+    }
+
+    void set_ray(size_t k, const ray& r) {
+        ox[k] = r.origin().x();    oy[k] = r.origin().y();    oz[k] = r.origin().z();
+        dx[k] = r.direction().x(); dy[k] = r.direction().y(); dz[k] = r.direction().z();
+        tm[k] = r.time();
+    }
+
+    // drops every path that isn't alive, keeping the rest in order
+    void compact() {
+        keep.clear();
+        for (size_t k = 0; k < size(); k++)
+            if (alive[k])
+                keep.push_back(int(k));
+        if (keep.size() == size())
+            return;
+
+        gather(ox); gather(oy); gather(oz);
+        gather(dx); gather(dy); gather(dz);
+        gather(tm);
+        gather(tr); gather(tg); gather(tb);
+        gather(pdf);
+        gather(slot);
+        gather(samples);
+        resize(keep.size());
+        // alive paths are all that's left. attenuation and hits are rewritten every bounce
+        // before they're read, so they only need the right size.
+        for (size_t k = 0; k < size(); k++)
+            alive[k] = 1;
+    }
+
+  private:
+    std::vector<int> keep;
+
+    void resize(size_t n) {
+        ox.resize(n); oy.resize(n); oz.resize(n);
+        dx.resize(n); dy.resize(n); dz.resize(n);
+        tm.resize(n);
+        tr.resize(n); tg.resize(n); tb.resize(n);
+        ar.resize(n); ag.resize(n); ab.resize(n);
+        pdf.resize(n);
+        slot.resize(n);
+        samples.resize(n);
+        hits.resize(n);
+        alive.resize(n);
+    }
+
+    template <typename T>
+    void gather(std::vector<T>& v) const {
+        for (size_t n = 0; n < keep.size(); n++)
+            v[n] = v[keep[n]];
+    }
+};
+
+/*
+Traces a batch of paths a bounce at a time instead of one path to the end. Each bounce runs
+as stages over the whole queue:
+    intersect  closest hit for every path
+    miss       paths that left the scene take the background
+    sort       counting sort of the hits by material kind
+    emit       paths that hit a light take its light and end
+    shade      scatter each kind's paths in a loop of its own, with no virtual call, and
+               sample the lights for the diffuse ones
+    shadow     shadow rays for the light samples, adding the light of those that get through
+    roulette   throughput update and russian roulette
+    compact    drop finished paths
+Estimates exactly what camera::trace_path does, with the same random numbers, so for a given
+seed it renders the same image.
+*/
+class wavefront_integrator {
+  public:
+    int max_depth = 10;
+    int roulette_depth = 3;
+    const light_list* lights = nullptr; // to sample at diffuse bounces, as camera::lights
+
+    // traces every path in the queue to the end, leaving the queue empty. each path's
+    // radiance is added to results[slot], which should start out black.
+    template <typename World, typename Background>
+    void trace(path_queue& queue, const World& world, Background&& background, colour* results) {
+        ray_counters& counters = ray_counters::local();
+        for (int depth = 0; depth < max_depth && queue.size() > 0; depth++) {
+            // a clock read per bounce of a whole batch is cheap enough to always do
+            scoped_seconds timer(counters.seconds_slot(depth));
+            counters.count_ray(depth, queue.size());
+            { RT_SCOPE("intersect"); intersect(queue, world); }
+            { RT_SCOPE("miss");      miss(queue, background, results); }
+            { RT_SCOPE("sort");      sort_by_material(queue); }
+            { RT_SCOPE("emit");      emit(queue, results); }
+            { RT_SCOPE("shade");     shade(queue); }
+            { RT_SCOPE("shadow");    shadow(queue, world, results); }
+            { RT_SCOPE("roulette");  roulette(queue, depth); }
+            { RT_SCOPE("compact");   queue.compact(); }
+        }
+        // anything still going has exceeded max depth and contributes nothing
+        queue.clear();
+    }
+
+  private:
+    static constexpr int kind_count = int(material_kind::other) + 1;
+
+    std::vector<uint8_t> found;      // per path, whether intersect found a hit
+    std::vector<int>     order;      // hit paths sorted by material kind
+    int bucket_start[kind_count + 1];
+
+    // a light sample waiting on its shadow ray
+    struct shadow_test {
+        ray    r;
+        real   distance;
+        colour direct;
+        int    path;
+    };
+    std::vector<shadow_test> shadow_tests;
+
+    template <typename World>
+    void intersect(path_queue& q, const World& world) {
+        found.resize(q.size());
+        for (size_t k = 0; k < q.size(); k++)
+            // ignoring hits that are very close to zero i.e. removes shadow acne
+            found[k] = world.hit(q.get_ray(k), interval(0.001, infinity), q.hits[k]);
+    }
+
+    template <typename Background>
+    void miss(path_queue& q, Background& background, colour* results) {
+        for (size_t k = 0; k < q.size(); k++) {
+            if (found[k])
+                continue;
+            results[q.slot[k]] += colour(q.tr[k], q.tg[k], q.tb[k]) * background(q.get_ray(k));
+            q.alive[k] = 0;
+        }
+    }
+
+    void sort_by_material(const path_queue& q) {
+        int counts[kind_count] = {};
+        for (size_t k = 0; k < q.size(); k++)
+            if (found[k])
+                counts[int(q.hits[k].material_ptr->kind)]++;
+
+        bucket_start[0] = 0;
+        for (int b = 0; b < kind_count; b++)
+            bucket_start[b + 1] = bucket_start[b] + counts[b];
+
+        int next[kind_count];
+        for (int b = 0; b < kind_count; b++)
+            next[b] = bucket_start[b];
+        order.resize(bucket_start[kind_count]);
+        for (size_t k = 0; k < q.size(); k++)
+            if (found[k])
+                order[next[int(q.hits[k].material_ptr->kind)]++] = int(k);
+    }
+
+    void emit(path_queue& q, colour* results) {
+        int kind = int(material_kind::emissive);
+        for (int n = bucket_start[kind]; n < bucket_start[kind + 1]; n++) {
+            int k = order[n];
+            const hit_record& rec = q.hits[k];
+            colour emit = static_cast<const diffuse_light&>(*rec.material_ptr).emitted(rec);
+            real weight = lights && q.pdf[k] > 0 ? lights->brdf_weight(q.get_ray(k), rec, emit, q.pdf[k]) : 1;
+            results[q.slot[k]] += weight * (colour(q.tr[k], q.tg[k], q.tb[k]) * emit);
+            q.alive[k] = 0;
+        }
+    }
+
+    void shade(path_queue& q) {
+        shadow_tests.clear();
+        shade_bucket<lambertian>(q, material_kind::lambertian);
+        shade_bucket<metal>(q, material_kind::metal);
+        shade_bucket<dielectric>(q, material_kind::dielectric);
+        shade_bucket<material>(q, material_kind::other);
+    }
+
+    // scatters every path in one material kind's bucket. M is the concrete class, which is
+    // final, so the scatter call is direct; for 'other' M is the base and the call is virtual.
+    template <typename M>
+    void shade_bucket(path_queue& q, material_kind kind) {
+        for (int n = bucket_start[int(kind)]; n < bucket_start[int(kind) + 1]; n++) {
+            int k = order[n];
+            const hit_record& rec = q.hits[k];
+            const M& m = static_cast<const M&>(*rec.material_ptr);
+            ray r = q.get_ray(k);
+
+            if constexpr (std::is_same_v<M, lambertian>) {
+                shadow_test test;
+                if (lights && lights->sample_direct(rec, m.albedo, r.time(), q.samples[k], test.r, test.distance, test.direct)) {
+                    test.path = k;
+                    shadow_tests.push_back(test);
+                }
+            }
+
+            ray scattered;
+            colour attenuation;
+            if (!m.scatter(r, rec, attenuation, scattered, q.samples[k])) {
+                q.alive[k] = 0;
+                continue;
+            }
+            if constexpr (std::is_same_v<M, lambertian>)
+                q.pdf[k] = lights ? lambertian::pdf(rec, scattered) : 0;
+            else
+                q.pdf[k] = 0;
+            q.set_ray(k, scattered);
+            q.ar[k] = attenuation.x();
+            q.ag[k] = attenuation.y();
+            q.ab[k] = attenuation.z();
+        }
+    }
+
+    // before roulette, so the light is carried by the throughput up to this bounce
+    template <typename World>
+    void shadow(const path_queue& q, const World& world, colour* results) {
+        for (const auto& test : shadow_tests) {
+            RT_COUNT(shadow_ray);
+            hit_record blocker; // only whether there is one matters, so no surface
+            if (!world.intersect(test.r, interval(0.001, test.distance), blocker)) {
+                int k = test.path;
+                results[q.slot[k]] += colour(q.tr[k], q.tg[k], q.tb[k]) * test.direct;
+            }
+        }
+    }
+
+    void roulette(path_queue& q, int depth) {
+        size_t n = q.size();
+        // dead paths get multiplied too, it's cheaper than branching and they're dropped next
+        for (size_t k = 0; k < n; k++) {
+            q.tr[k] *= q.ar[k];
+            q.tg[k] *= q.ag[k];
+            q.tb[k] *= q.ab[k];
+        }
+
+        if (depth + 1 < roulette_depth)
+            return;
+
+        for (size_t k = 0; k < n; k++) {
+            if (!q.alive[k])
+                continue;
+            real survive = std::fmin(real(0.95), std::fmax(q.tr[k], std::fmax(q.tg[k], q.tb[k])));
+            if (q.samples[k].get_1d() >= survive) {
+                q.alive[k] = 0;
+                continue;
+            }
+            real scale = 1 / survive;
+            q.tr[k] *= scale;
+            q.tg[k] *= scale;
+            q.tb[k] *= scale;
+        }
+    }
+};
+
+#endif